@@ -0,0 +1,53 @@
+#include "VulkanStubs.h"
+
+std::vector<StubCall>& GetStubCalls()
+{
+	static std::vector<StubCall> calls;
+	return calls;
+}
+
+// Note:	The prototypes in vulkan_core.h already give these C linkage, the project doesn't link the loader so
+//			these are the only definitions
+VKAPI_ATTR void VKAPI_CALL vkCmdBindPipeline(VkCommandBuffer, VkPipelineBindPoint, VkPipeline)
+{
+	GetStubCalls().push_back({ StubCallType::BindPipeline });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindVertexBuffers(VkCommandBuffer, uint32_t, uint32_t, const VkBuffer*,
+	const VkDeviceSize*)
+{
+	GetStubCalls().push_back({ StubCallType::BindVertexBuffers });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBindIndexBuffer(VkCommandBuffer, VkBuffer, VkDeviceSize, VkIndexType)
+{
+	GetStubCalls().push_back({ StubCallType::BindIndexBuffer });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdSetViewport(VkCommandBuffer, uint32_t, uint32_t, const VkViewport*)
+{
+	GetStubCalls().push_back({ StubCallType::SetViewport });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdSetScissor(VkCommandBuffer, uint32_t, uint32_t, const VkRect2D*)
+{
+	GetStubCalls().push_back({ StubCallType::SetScissor });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPushConstants(VkCommandBuffer, VkPipelineLayout, VkShaderStageFlags, uint32_t,
+	uint32_t, const void*)
+{
+	GetStubCalls().push_back({ StubCallType::PushConstants });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDraw(VkCommandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t,
+	uint32_t firstInstance)
+{
+	GetStubCalls().push_back({ StubCallType::Draw, vertexCount, instanceCount, firstInstance });
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdDrawIndexed(VkCommandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t,
+	int32_t, uint32_t firstInstance)
+{
+	GetStubCalls().push_back({ StubCallType::DrawIndexed, indexCount, instanceCount, firstInstance });
+}
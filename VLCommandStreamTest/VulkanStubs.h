@@ -0,0 +1,32 @@
+#pragma once
+
+// Stand-ins for the vkCmd* functions the command stream and recorder call, so Replay can run without a device.
+// Every call is appended to GetStubCalls() instead of being recorded into a command buffer.
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <vector>
+
+enum class StubCallType
+{
+	BindPipeline,
+	BindVertexBuffers,
+	BindIndexBuffer,
+	SetViewport,
+	SetScissor,
+	PushConstants,
+	Draw,
+	DrawIndexed
+};
+
+struct StubCall
+{
+	StubCallType Type;
+	// Vertex or index count for draws, zero for everything else
+	uint32_t Count = 0;
+	uint32_t InstanceCount = 0;
+	uint32_t FirstInstance = 0;
+};
+
+std::vector<StubCall>& GetStubCalls();
@@ -0,0 +1,310 @@
+// Headless checks and a production benchmark for VLCommandStream.
+// Nothing here creates a device: commands are read back through ForEach, and Replay records into the vkCmd* stubs
+// of VulkanStubs.cpp.
+
+#include "VLCommandRecorder.h"
+#include "VLCommandStream.h"
+#include "VulkanStubs.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace VulkanLearn;
+
+namespace
+{
+	int FailureCount = 0;
+
+	void Check(bool bCondition, const char* pDescription)
+	{
+		if (!bCondition)
+		{
+			std::cerr << "FAILED: " << pDescription << '\n';
+			FailureCount++;
+		}
+	}
+
+	struct RecordedCommand
+	{
+		VLCommandType Type;
+		uint32_t Size;
+		const void* pPayload;
+	};
+
+	std::vector<RecordedCommand> Collect(const VLCommandStream& Stream)
+	{
+		std::vector<RecordedCommand> commands;
+		Stream.ForEach([&](const VLCommandHeader& Header, const void* pPayload)
+			{
+				commands.push_back({ Header.Type, Header.Size, pPayload });
+			});
+		return commands;
+	}
+
+	// Replays Stream through a fresh recorder and returns the Vulkan calls it made
+	std::vector<StubCall> Replay(const VLCommandStream& Stream)
+	{
+		GetStubCalls().clear();
+		VLCommandRecorder recorder{ reinterpret_cast<VkCommandBuffer>(uintptr_t{ 0x4000 }) };
+		Stream.Replay(recorder);
+		return GetStubCalls();
+	}
+
+	void TestRoundTrip()
+	{
+		VLCommandStream stream{ 4096 };
+
+		VkViewport viewport{ 0.0f, 0.0f, 800.0f, 600.0f, 0.0f, 1.0f };
+		VkRect2D scissor{ { 0, 0 }, { 800, 600 } };
+		// Note:	Handles are only compared, never used, so any non-null value works
+		const VkPipeline pipeline = reinterpret_cast<VkPipeline>(uintptr_t{ 0x1000 });
+		const VkBuffer buffer = reinterpret_cast<VkBuffer>(uintptr_t{ 0x2000 });
+		const VkPipelineLayout layout = reinterpret_cast<VkPipelineLayout>(uintptr_t{ 0x3000 });
+		const float pushData[3] = { 1.0f, 2.0f, 3.0f };
+
+		stream.SetViewport(viewport);
+		stream.SetScissor(scissor);
+		stream.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		stream.BindVertexBuffer(1, buffer, 256);
+		stream.BindIndexBuffer(buffer, 64, VK_INDEX_TYPE_UINT32);
+		stream.PushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushData), pushData);
+		stream.Draw(3, 4, 0, 8);
+		stream.DrawIndexed(6, 1, 12, -3, 2);
+
+		const std::vector<RecordedCommand> commands = Collect(stream);
+		Check(stream.GetCommandCount() == 8, "command count matches the recorded commands");
+		Check(commands.size() == 8, "ForEach visits every command");
+		if (commands.size() != 8)
+		{
+			return;
+		}
+
+		size_t visitedBytes = 0;
+		for (const RecordedCommand& command : commands)
+		{
+			Check(reinterpret_cast<uintptr_t>(command.pPayload) % 8 == 0, "payloads are 8 byte aligned");
+			Check(command.Size % 8 == 0, "command sizes keep the next header aligned");
+			visitedBytes += command.Size;
+		}
+		Check(visitedBytes == stream.GetUsedBytes(), "command sizes add up to the used bytes");
+
+		Check(commands[0].Type == VLCommandType::SetViewport, "viewport comes first");
+		Check(std::memcmp(&static_cast<const VLSetViewportCommand*>(commands[0].pPayload)->Viewport, &viewport,
+			sizeof(viewport)) == 0, "viewport survives the round trip");
+
+		Check(commands[1].Type == VLCommandType::SetScissor, "scissor follows the viewport");
+		Check(static_cast<const VLSetScissorCommand*>(commands[1].pPayload)->Scissor.extent.height == 600,
+			"scissor survives the round trip");
+
+		Check(commands[2].Type == VLCommandType::BindPipeline, "pipeline bind is third");
+		Check(static_cast<const VLBindPipelineCommand*>(commands[2].pPayload)->Pipeline == pipeline,
+			"pipeline handle survives the round trip");
+
+		Check(commands[3].Type == VLCommandType::BindVertexBuffer, "vertex buffer bind is fourth");
+		const VLBindVertexBufferCommand& vertexBind = *static_cast<const VLBindVertexBufferCommand*>(commands[3].pPayload);
+		Check(vertexBind.Binding == 1 && vertexBind.Buffer == buffer && vertexBind.Offset == 256,
+			"vertex buffer bind survives the round trip");
+
+		Check(commands[4].Type == VLCommandType::BindIndexBuffer, "index buffer bind is fifth");
+		const VLBindIndexBufferCommand& indexBind = *static_cast<const VLBindIndexBufferCommand*>(commands[4].pPayload);
+		Check(indexBind.Offset == 64 && indexBind.IndexType == VK_INDEX_TYPE_UINT32,
+			"index buffer bind survives the round trip");
+
+		Check(commands[5].Type == VLCommandType::PushConstants, "push constants are sixth");
+		const VLPushConstantsCommand& push = *static_cast<const VLPushConstantsCommand*>(commands[5].pPayload);
+		Check(push.Layout == layout && push.Size == sizeof(pushData), "push constant range survives the round trip");
+		Check(std::memcmp(&push + 1, pushData, sizeof(pushData)) == 0, "push constant data follows the command");
+
+		Check(commands[6].Type == VLCommandType::Draw, "draw is seventh");
+		const VLDrawCommand& draw = *static_cast<const VLDrawCommand*>(commands[6].pPayload);
+		Check(draw.VertexCount == 3 && draw.InstanceCount == 4 && draw.FirstInstance == 8,
+			"draw survives the round trip");
+
+		Check(commands[7].Type == VLCommandType::DrawIndexed, "indexed draw is last");
+		const VLDrawIndexedCommand& drawIndexed = *static_cast<const VLDrawIndexedCommand*>(commands[7].pPayload);
+		Check(drawIndexed.FirstIndex == 12 && drawIndexed.VertexOffset == -3,
+			"indexed draw survives the round trip");
+	}
+
+	void TestAppendAndReset()
+	{
+		VLCommandStream first{ 1024 };
+		VLCommandStream second{ 1024 };
+		first.Draw(3, 1, 0, 0);
+		second.Draw(6, 1, 3, 1);
+		second.Draw(9, 1, 9, 2);
+
+		first.Append(second);
+		const std::vector<RecordedCommand> commands = Collect(first);
+		Check(first.GetCommandCount() == 3 && commands.size() == 3, "append adds the commands of the other stream");
+		if (commands.size() == 3)
+		{
+			Check(static_cast<const VLDrawCommand*>(commands[2].pPayload)->VertexCount == 9,
+				"appended commands keep their order");
+		}
+
+		first.Reset();
+		Check(first.GetCommandCount() == 0 && first.GetUsedBytes() == 0, "reset rewinds the stream");
+		Check(Collect(first).empty(), "a reset stream has nothing to visit");
+		Check(first.GetCapacity() == 1024, "reset keeps the arena");
+	}
+
+	void TestOverflow()
+	{
+		VLCommandStream stream{ 64 };
+		bool bThrown = false;
+		try
+		{
+			for (int i = 0; i < 16; i++)
+			{
+				stream.Draw(3, 1, 0, 0);
+			}
+		}
+		catch (const std::runtime_error&)
+		{
+			bThrown = true;
+		}
+		Check(bThrown, "a full stream throws instead of growing");
+		Check(stream.GetUsedBytes() <= stream.GetCapacity(), "a full stream never writes past its arena");
+	}
+
+	void TestReplayMerge()
+	{
+		VLCommandStream stream{ 1024 };
+		stream.Draw(3, 1, 0, 0);
+		stream.Draw(3, 2, 0, 1);
+		stream.Draw(3, 1, 0, 3);
+		stream.DrawIndexed(6, 1, 0, 0, 10);
+		stream.DrawIndexed(6, 4, 0, 0, 11);
+		// Different range, starts a draw of its own even though the instances follow
+		stream.DrawIndexed(12, 1, 0, 0, 15);
+
+		const std::vector<StubCall> calls = Replay(stream);
+		Check(calls.size() == 3, "consecutive draws of the same range are merged");
+		if (calls.size() != 3)
+		{
+			return;
+		}
+		Check(calls[0].Type == StubCallType::Draw && calls[0].InstanceCount == 4 && calls[0].FirstInstance == 0,
+			"merged draw covers all instances");
+		Check(calls[1].Type == StubCallType::DrawIndexed && calls[1].InstanceCount == 5 && calls[1].FirstInstance == 10,
+			"merged indexed draw covers all instances");
+		Check(calls[2].Type == StubCallType::DrawIndexed && calls[2].Count == 12 && calls[2].InstanceCount == 1,
+			"draws of another range are kept apart");
+	}
+
+	void TestReplayStateChange()
+	{
+		VLCommandStream stream{ 1024 };
+		const VkPipeline pipeline = reinterpret_cast<VkPipeline>(uintptr_t{ 0x1000 });
+		const VkPipelineLayout layout = reinterpret_cast<VkPipelineLayout>(uintptr_t{ 0x3000 });
+		const uint32_t pushData = 7;
+
+		stream.Draw(3, 1, 0, 0);
+		stream.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+		stream.Draw(3, 1, 0, 1);
+		stream.PushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushData), &pushData);
+		stream.Draw(3, 1, 0, 2);
+
+		const std::vector<StubCall> calls = Replay(stream);
+		Check(calls.size() == 5, "draws are not merged across state changes");
+		if (calls.size() != 5)
+		{
+			return;
+		}
+		Check(calls[0].Type == StubCallType::Draw && calls[0].FirstInstance == 0, "first draw is recorded before the bind");
+		Check(calls[1].Type == StubCallType::BindPipeline, "pipeline bind stays between the draws");
+		Check(calls[2].Type == StubCallType::Draw && calls[2].InstanceCount == 1 && calls[2].FirstInstance == 1,
+			"draw after the bind starts a new draw");
+		Check(calls[3].Type == StubCallType::PushConstants, "push constants stay between the draws");
+		Check(calls[4].Type == StubCallType::Draw && calls[4].InstanceCount == 1 && calls[4].FirstInstance == 2,
+			"draw after the push starts a new draw");
+	}
+
+	void TestReplayNonContiguous()
+	{
+		VLCommandStream stream{ 1024 };
+		stream.Draw(3, 2, 0, 0);
+		// Instance 2 is skipped, so this one can't extend the previous draw
+		stream.Draw(3, 1, 0, 3);
+		stream.DrawIndexed(6, 1, 0, 0, 5);
+		stream.DrawIndexed(6, 1, 0, 0, 5);
+
+		const std::vector<StubCall> calls = Replay(stream);
+		Check(calls.size() == 4, "draws with a gap or overlap in their instances are not merged");
+		if (calls.size() != 4)
+		{
+			return;
+		}
+		Check(calls[0].InstanceCount == 2 && calls[1].InstanceCount == 1 && calls[1].FirstInstance == 3,
+			"draws around a gap keep their instances");
+		Check(calls[2].FirstInstance == 5 && calls[3].FirstInstance == 5, "repeated instances are drawn twice");
+	}
+
+	// Times producing a frame of draws, the part of recording that runs before any Vulkan call
+	void BenchmarkProduction()
+	{
+		constexpr uint32_t drawCount = 100000;
+		constexpr int iterations = 20;
+		VLCommandStream stream{ 8 * 1024 * 1024 };
+		const VkPipeline pipeline = reinterpret_cast<VkPipeline>(uintptr_t{ 0x1000 });
+		const VkPipelineLayout layout = reinterpret_cast<VkPipelineLayout>(uintptr_t{ 0x3000 });
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			stream.Reset();
+			stream.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			for (uint32_t draw = 0; draw < drawCount; draw++)
+			{
+				const uint32_t pushData[4] = { draw, draw, draw, draw };
+				stream.PushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushData), pushData);
+				stream.Draw(3, 1, 0, draw);
+			}
+		}
+		const std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+
+		size_t drawsVisited = 0;
+		stream.ForEach([&](const VLCommandHeader& Header, const void*)
+			{
+				drawsVisited += Header.Type == VLCommandType::Draw ? 1 : 0;
+			});
+		Check(drawsVisited == drawCount, "benchmark stream holds every draw");
+
+		std::cout << "Produced " << drawCount << " draws with push constants in "
+			<< seconds.count() * 1000.0 / iterations << " ms per frame, "
+			<< stream.GetUsedBytes() / 1024 << " KB of commands" << std::endl;
+	}
+}
+
+int main()
+{
+	try
+	{
+		TestRoundTrip();
+		TestAppendAndReset();
+		TestOverflow();
+		TestReplayMerge();
+		TestReplayStateChange();
+		TestReplayNonContiguous();
+		BenchmarkProduction();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	if (FailureCount > 0)
+	{
+		std::cerr << FailureCount << " checks failed\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "All command stream checks passed" << std::endl;
+	return EXIT_SUCCESS;
+}
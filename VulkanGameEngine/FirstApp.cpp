@@ -5,26 +5,47 @@
 #include <glm/glm.hpp>
 #include <stdexcept>
 #include <array>
-
-// Note:	In the future, once the struct gets bigger with different uses for Shader stages, specialized structs
-//			should be created.
-struct SharedPushConstantsData
-{
-	glm::vec2 offset;
-	alignas(16) glm::vec3 color;
-};
+#include <iostream>
+
+// Size of the transient data each frame in flight can allocate
+static constexpr VkDeviceSize FrameDataPartitionSize = 4 * 1024 * 1024;
+// Capacity of the shared geometry buffers
+static constexpr VkDeviceSize MeshPoolVertexCount = 64 * 1024;
+static constexpr VkDeviceSize MeshPoolIndexCount = 256 * 1024;
+// Copies of the model drawn with a single instanced draw
+static constexpr uint32_t InstanceCount = 4;
+// Size of the static background grid
+static constexpr uint32_t BackgroundColumns = 32;
+static constexpr uint32_t BackgroundRows = 24;
+// Bytes of mesh pool data the defragmenter may copy per frame
+static constexpr VkDeviceSize MeshPoolDefragmentBudget = 64 * 1024;
+// Frames between two statistics reports
+static constexpr uint64_t StatisticsInterval = 600;
+// Arena of the command stream every recording slice produces its draws into
+static constexpr size_t SliceCommandStreamSize = 64 * 1024;
 
 FirstApp::FirstApp()
 {
+	CreateFrameContexts();
+	DrawRecorder = std::make_unique<VLParallelRecorder>(AppDevice, VLSwapChain::MAX_FRAMES_IN_FLIGHT);
+	SliceCommands.resize(DrawRecorder->GetThreadCount());
+	for (auto& sliceCommands : SliceCommands)
+	{
+		sliceCommands = std::make_unique<VLCommandStream>(SliceCommandStreamSize);
+	}
+	ResidencyManager = std::make_unique<VLResidencyManager>(AppDevice);
 	LoadModels();
+	CreateLayers();
+	// Upload all vertex data in a single batch
+	AppDevice.GetUploadEngine().Submit();
 	CreatePipelineLayout();
 	RecreateSwapChain();
-	CreateCommandBuffers();
 }
 
 FirstApp::~FirstApp()
 {
-	vkDestroyPipelineLayout(AppDevice.GetDevice(), PipelineLayout, nullptr);
+	vkDestroyPipelineLayout(AppDevice.GetDevice(), PipelineLayout,
+		AppDevice.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline));
 }
 
 void FirstApp::run()
@@ -49,26 +70,26 @@ void FirstApp::LoadModels()
 		{{-0.5f, 0.5f}, {0, 0, 1}}
 	};
 
-	AppModel = std::make_unique<VLModel>(AppDevice, vertices);
+	MeshPool = std::make_unique<VLMeshPool>(AppDevice, MeshPoolVertexCount, sizeof(VLModel::Vertex), MeshPoolIndexCount);
+	AppModel = std::make_unique<VLModel>(AppDevice, *MeshPool, vertices);
+
+	// Note:	Keeps a host copy of the vertices to stream them back in after an eviction
+	BackgroundModel = std::make_unique<VLModel>(AppDevice, vertices);
+	BackgroundModel->EnableResidency(*ResidencyManager, vertices);
 }
 
 void FirstApp::CreatePipelineLayout()
 {
-	VkPushConstantRange pushConstantRange{};
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-	// Offset is mainly for if you are using separate ranges for different stages
-	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(SharedPushConstantsData);
-
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 0;
 	// Can be used to send data other than our vertex data to our shaders
 	pipelineLayoutInfo.pSetLayouts = nullptr;
-	// Can be used to Efficiently send a small amount of data to our shader programs
-	pipelineLayoutInfo.pushConstantRangeCount = 1;
-	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
-	if (vkCreatePipelineLayout(AppDevice.GetDevice(), &pipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
+	// Note:	The instanced shader reads everything per instance from the frame ring, it has no push constants
+	pipelineLayoutInfo.pushConstantRangeCount = 0;
+	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	if (vkCreatePipelineLayout(AppDevice.GetDevice(), &pipelineLayoutInfo,
+		AppDevice.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline), &PipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create pipeline layout!");
 	}
@@ -85,17 +106,14 @@ void FirstApp::RecreateSwapChain()
 		glfwWaitEvents();
 	}
 
-	vkDeviceWaitIdle(AppDevice.GetDevice());
-	AppSwapChain.reset(nullptr);
+	// Note:	No need to wait for the device to go idle, the old swap chain and pipeline are destroyed through
+	//			the deletion queue once the frames still using them have completed
 	if (AppSwapChain == nullptr) {
 		AppSwapChain = std::make_unique<VLSwapChain>(AppDevice, extent);
 	}
 	else {
+		// Note:	The frame contexts don't depend on the swap chain images, they are kept as they are
 		AppSwapChain = std::make_unique<VLSwapChain>(AppDevice, extent, std::move(AppSwapChain));
-		if (AppSwapChain->GetImageCount() != CommandBuffers.size()) {
-			FreeCommandBuffers();
-			CreateCommandBuffers();
-		}
 	}
 	// Note:	Pipeline is Dependant on the swap chain
 	// TODO:	Only recreate pipeline if the render pass is not compatible
@@ -120,36 +138,64 @@ void FirstApp::DrawFrame()
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	RecordCommandBuffer(imageIndex);
+	// Note:	AcquireNextImage waited for the previous frame of this slot, so everything its context handed out
+	//			last time around can be reused
+	VLFrameContext& frameContext = *FrameContexts[AppSwapChain->GetCurrentFrame()];
+	frameContext.Begin();
+	DrawRecorder->BeginFrame(AppSwapChain->GetCurrentFrame());
+	UpdateResidency();
+
+	// Note:	The instance data in the frame ring animates every frame, so the command buffer is recorded from
+	//			scratch each time
+	VkCommandBuffer commandBuffer = frameContext.GetCommandBuffer();
+	RecordCommandBuffer(frameContext, imageIndex);
+
+	// Note:	Submit to provided Graphics queue + Handle CPU and GPU synchronization
+	//			Command buffer will then be executed
+	//			Then the Swap chain will present associated attachment image view to the display
+	// Note:	Always submit once the image is acquired, recreating first would leave the image available
+	//			semaphore signaled without anything waiting on it
+	result = AppSwapChain->SubmitCommandBuffers(&commandBuffer, &imageIndex);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || AppWindow.WasWindowResized())
 	{
 		AppWindow.ResetWindowResizedFlag();
 		RecreateSwapChain();
 		return;
 	}
-
-	// Note:	Submit to provided Graphics queue + Handle CPU and GPU synchronization
-	//			Command buffer will then be executed
-	//			Then the Swap chain will present associated attachment image view to the display
-	result = AppSwapChain->SubmitCommandBuffers(&CommandBuffers[imageIndex], &imageIndex);
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to present swap chain image!");
 	}
+
+	FrameCount++;
+	if (FrameCount % StatisticsInterval == 0)
+	{
+		ReportStatistics();
+	}
 }
 
-void FirstApp::RecordCommandBuffer(int imageIndex)
+void FirstApp::RecordCommandBuffer(VLFrameContext& frameContext, int imageIndex)
 {
-	// TODO: Remove this simple loop setup as it is part of the push constants test 
+	// TODO: Remove this simple loop setup as it is part of the instancing test 
 	static int frame = 0;
 	frame = (frame + 1) % 10000;
 
+	VkCommandBuffer commandBuffer = frameContext.GetCommandBuffer();
+
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	if (vkBeginCommandBuffer(CommandBuffers[imageIndex], &beginInfo) != VK_SUCCESS) {
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to begin recording command buffer!");
 	}
 
+	// Note:	Copies can't be recorded inside the render pass. The moved ranges are read at their new offsets
+	//			from here on, so the cached layers that baked in the old ones are re-recorded.
+	if (MeshPool->Defragment(commandBuffer, MeshPoolDefragmentBudget))
+	{
+		BackgroundLayer->Invalidate();
+	}
+
 	VkRenderPassBeginInfo renderPassInfo{};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	renderPassInfo.renderPass = AppSwapChain->GetRenderPass();
@@ -165,9 +211,9 @@ void FirstApp::RecordCommandBuffer(int imageIndex)
 	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 	renderPassInfo.pClearValues = clearValues.data();
 
-	// Note:	VK_SUBPASS_CONTENTS_INLINE signals that the subsequent render pass commands will be 
-	//			directly embedded in the primary command buffer itself. + no secondary will be used
-	vkCmdBeginRenderPass(CommandBuffers[imageIndex], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Note:	VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS signals that the render pass commands are recorded in
+	//			secondary command buffers, the primary one only executes them
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
 	VkViewport viewport{};
 	viewport.x = 0.0f;
@@ -177,28 +223,60 @@ void FirstApp::RecordCommandBuffer(int imageIndex)
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 	VkRect2D scissor{ {0, 0}, AppSwapChain->GetSwapChainExtent() };
-	vkCmdSetViewport(CommandBuffers[imageIndex], 0, 1, &viewport);
-	vkCmdSetScissor(CommandBuffers[imageIndex], 0, 1, &scissor);
-
-	AppPipeline->Bind(CommandBuffers[imageIndex]);
-	AppModel->Bind(CommandBuffers[imageIndex]);
 
 	// TODO:	Correct this piece of code
-	//			This is simply meant to test out the push constants and draw the same copy of our triangle
-	//			using different push data
-	for (uint32_t index = 0; index < 4; index++)
+	//			This is simply meant to test out instancing and draw the same copy of our triangle
+	//			using different per-instance data
+	std::array<VLModel::Instance, InstanceCount> instanceData{};
+	for (uint32_t index = 0; index < InstanceCount; index++)
 	{
-		SharedPushConstantsData push{};
-		push.offset = { -0.5f + frame * 0.0002f, -0.4 + index * 0.25f };
-		push.color = { 0.0f, 0.0f, 0.2f + 0.2f * index };
-
-		vkCmdPushConstants(CommandBuffers[imageIndex], PipelineLayout,
-			VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SharedPushConstantsData), &push);
-		AppModel->Draw(CommandBuffers[imageIndex]);
+		VLModel::Instance& instance = instanceData[index];
+		instance.Transform = glm::mat2{ 1.0f };
+		instance.Offset = { -0.5f + frame * 0.0002f, -0.4 + index * 0.25f };
+		instance.Color = { 0.0f, 0.0f, 0.2f + 0.2f * index };
 	}
-
-	vkCmdEndRenderPass(CommandBuffers[imageIndex]);
-	if (vkEndCommandBuffer(CommandBuffers[imageIndex]) != VK_SUCCESS)
+	// Note:	The instances are built on the stack and streamed into the ring of this frame in one go, the ring is
+	//			write-combined memory that should never be written field by field. A 4MB partition fits about 116k.
+	const VLRingAllocation instances = frameContext.GetRing().PushArray(instanceData.data(), instanceData.size());
+
+	// Note:	All copies go out in a single draw call
+	RenderQueue.Reset();
+	RenderQueue.SubmitInstanced(VLRenderQueue::MakeSortKey(0, 0, 0, 0, 0), *AppPipeline, *AppModel, InstanceCount);
+	RenderQueue.Sort();
+
+	// Note:	Every slice produces its draws into a command stream of its own and only then touches its command
+	//			buffer. Secondary command buffers inherit no state, so each stream sets up everything it uses.
+	DrawRecorder->Record(
+		commandBuffer,
+		AppSwapChain->GetRenderPass(),
+		0,
+		AppSwapChain->GetFrameBuffer(imageIndex),
+		RenderQueue.GetDrawCount(),
+		[&](VkCommandBuffer secondaryBuffer, uint32_t sliceIndex, uint32_t firstDraw, uint32_t drawCount)
+		{
+			VLCommandStream& stream = *SliceCommands[sliceIndex];
+			stream.Reset();
+			stream.SetViewport(viewport);
+			stream.SetScissor(scissor);
+			VLModel::BindInstances(stream, instances.Buffer, instances.Offset);
+			RenderQueue.Emit(stream, firstDraw, drawCount);
+
+			VLCommandRecorder recorder{ secondaryBuffer };
+			stream.Replay(recorder);
+			Counters.IssuedCalls += recorder.GetStatistics().IssuedCalls;
+			Counters.SkippedCalls += recorder.GetStatistics().SkippedCalls;
+		});
+	const VLRenderQueueStatistics queueStatistics = RenderQueue.GetStatistics();
+	Counters.Draws += queueStatistics.DrawCount;
+	Counters.SavedBinds += queueStatistics.SavedBinds;
+
+	// Note:	Only records when the layer was invalidated, most frames just execute the cached buffer.
+	//			Executed after the moving triangles, the equal depth makes the grid fail the depth test behind them.
+	VLRenderLayer::Execute(
+		commandBuffer, { BackgroundLayer.get() }, AppSwapChain->GetCurrentFrame(), AppSwapChain->GetRenderPass(), 0);
+
+	vkCmdEndRenderPass(commandBuffer);
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to record command buffer!");
 	}
@@ -213,39 +291,115 @@ void FirstApp::CreatePipeline()
 	pipelineConfig.RenderPass = AppSwapChain->GetRenderPass();
 	pipelineConfig.PipelineLayout = PipelineLayout;
 	VLPipeline::DefaultPipelineConfigInfo(pipelineConfig);
+	// Second vertex stream with the per-instance data
+	const auto instanceBindings = VLModel::Instance::GetBindingDescriptions();
+	const auto instanceAttributes = VLModel::Instance::GetAttributeDescriptions();
+	pipelineConfig.BindingDescriptions.insert(
+		pipelineConfig.BindingDescriptions.end(), instanceBindings.begin(), instanceBindings.end());
+	pipelineConfig.AttributeDescriptions.insert(
+		pipelineConfig.AttributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
 	AppPipeline = std::make_unique<VLPipeline>(
 		AppDevice,
-		"Shaders/TestShader.vert.spv",
-		"Shaders/TestShader.frag.spv",
+		"Shaders/InstancedShader.vert.spv",
+		"Shaders/InstancedShader.frag.spv",
 		pipelineConfig);
+	// Note:	The cached layers refer to the old pipeline and viewport
+	if (BackgroundLayer != nullptr)
+	{
+		BackgroundLayer->Invalidate();
+	}
+}
+
+void FirstApp::CreateFrameContexts()
+{
+	FrameContexts.resize(VLSwapChain::MAX_FRAMES_IN_FLIGHT);
+	for (auto& frameContext : FrameContexts)
+	{
+		frameContext = std::make_unique<VLFrameContext>(
+			AppDevice,
+			FrameDataPartitionSize,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	}
+}
+
+void FirstApp::CreateLayers()
+{
+	// Note:	The grid never moves, so its instances live in a buffer of their own instead of the frame ring
+	std::vector<VLModel::Instance> instances;
+	instances.reserve(BackgroundColumns * BackgroundRows);
+	for (uint32_t row = 0; row < BackgroundRows; row++)
+	{
+		for (uint32_t column = 0; column < BackgroundColumns; column++)
+		{
+			VLModel::Instance instance{};
+			instance.Transform = glm::mat2{ 0.06f };
+			instance.Offset = {
+				-1.0f + (column + 0.5f) * 2.0f / BackgroundColumns,
+				-1.0f + (row + 0.5f) * 2.0f / BackgroundRows };
+			instance.Color = { 0.05f, 0.05f, 0.08f };
+			instances.push_back(instance);
+		}
+	}
+
+	const VkDeviceSize size = instances.size() * sizeof(VLModel::Instance);
+	BackgroundInstances = std::make_unique<VLMappedBuffer>(
+		AppDevice, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VLHostAccess::SequentialWrite);
+	BackgroundInstances->Write(instances.data(), size);
+
+	BackgroundLayer = std::make_unique<VLRenderLayer>(
+		AppDevice,
+		VLSwapChain::MAX_FRAMES_IN_FLIGHT,
+		[this](VLCommandRecorder& recorder) { RecordBackgroundLayer(recorder); });
+}
+
+void FirstApp::RecordBackgroundLayer(VLCommandRecorder& recorder)
+{
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(AppSwapChain->GetSwapChainExtent().width);
+	viewport.height = static_cast<float>(AppSwapChain->GetSwapChainExtent().height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	VkRect2D scissor{ {0, 0}, AppSwapChain->GetSwapChainExtent() };
+	recorder.SetViewport(viewport);
+	recorder.SetScissor(scissor);
+
+	AppPipeline->Bind(recorder);
+	BackgroundModel->Bind(recorder);
+	VLModel::BindInstances(recorder, BackgroundInstances->GetBuffer());
+	BackgroundModel->Draw(recorder.GetCommandBuffer(), BackgroundColumns * BackgroundRows);
 }
 
-void FirstApp::CreateCommandBuffers()
+void FirstApp::UpdateResidency()
 {
-	// TODO:	For simplicity make the command buffers one-to-one in size  to the image count 
-	//			to avoid rerecording the command every frame to specify the target output frame
-	CommandBuffers.resize(AppSwapChain->GetImageCount());
-
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	// Note:	Primary can be submitted to a queue for execution but cannot be called by other command buffers
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = AppDevice.GetCommandPool();
-	allocInfo.commandBufferCount = static_cast<uint32_t>(CommandBuffers.size());
-
-	if (vkAllocateCommandBuffers(AppDevice.GetDevice(), &allocInfo, CommandBuffers.data()) !=
-		VK_SUCCESS) 
+	// Note:	Runs on the main thread before anything is recorded, so recording never allocates or uploads.
+	//			The background layer is touched even when its cached buffer is only executed again.
+	AppModel->MakeResident();
+	if (BackgroundModel->MakeResident())
 	{
-		throw std::runtime_error("Failed to allocate command buffers!");
+		// The cached recordings refer to the vertex buffer that was evicted
+		BackgroundLayer->Invalidate();
 	}
+	// Note:	Everything this frame submits was touched above, so only models unused since a completed frame
+	//			are evicted
+	ResidencyManager->Update();
 }
 
-void FirstApp::FreeCommandBuffers()
+void FirstApp::ReportStatistics()
 {
-	vkFreeCommandBuffers(
-		AppDevice.GetDevice(),
-		AppDevice.GetCommandPool(),
-		static_cast<uint32_t>(CommandBuffers.size()),
-		CommandBuffers.data());
-	CommandBuffers.clear();
+	const VLTlsfBufferPool::Statistics vertexPool = MeshPool->GetVertexPool().GetStatistics();
+	std::cout << "Frame " << FrameCount
+		<< ": mesh pool " << vertexPool.UsedSize << "/" << vertexPool.Capacity << " bytes in "
+		<< vertexPool.AllocationCount << " allocations, fragmentation " << vertexPool.Fragmentation
+		<< std::endl;
+	std::cout << "\trender queue: " << static_cast<double>(Counters.Draws) / StatisticsInterval << " draws and "
+		<< static_cast<double>(Counters.SavedBinds) / StatisticsInterval << " saved binds per frame" << std::endl;
+	std::cout << "\tcommand recorder: " << static_cast<double>(Counters.IssuedCalls) / StatisticsInterval
+		<< " issued and " << static_cast<double>(Counters.SkippedCalls) / StatisticsInterval
+		<< " redundant calls skipped per frame" << std::endl;
+	Counters.Draws = 0;
+	Counters.SavedBinds = 0;
+	Counters.IssuedCalls = 0;
+	Counters.SkippedCalls = 0;
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
@@ -11,6 +12,14 @@
 #include "VLDevice.h"
 #include "VLSwapChain.h"
 #include "VLModel.h"
+#include "VLMeshPool.h"
+#include "VLFrameContext.h"
+#include "VLParallelRecorder.h"
+#include "VLRenderQueue.h"
+#include "VLCommandStream.h"
+#include "VLRenderLayer.h"
+#include "VLMappedBuffer.h"
+#include "VLResidencyManager.h"
 
 using namespace VulkanLearn;
 class FirstApp {
@@ -25,6 +34,7 @@ public:
 	FirstApp& operator=(const FirstApp&) = delete;
 
 	void run();
+	VLDevice& GetDevice() { return AppDevice; }
 
 	static constexpr int Width = 800;
 	static constexpr int Height = 600;
@@ -34,18 +44,52 @@ private:
 	void CreatePipelineLayout();
 	void RecreateSwapChain();
 	void DrawFrame();
-	void RecordCommandBuffer(int imageIndex);
+	void RecordCommandBuffer(VLFrameContext& frameContext, int imageIndex);
 	void CreatePipeline();
-	void CreateCommandBuffers();
-	void FreeCommandBuffers();
+	void CreateFrameContexts();
+	void CreateLayers();
+	void RecordBackgroundLayer(VLCommandRecorder& recorder);
+	// Streams in and touches every model the frame submits, then evicts what went unused
+	void UpdateResidency();
+	void ReportStatistics();
 
 	VLWindow AppWindow{ Width, Height, "Hello Vulkan!" };
 	VLDevice AppDevice{ AppWindow };
 	std::unique_ptr<VLSwapChain> AppSwapChain;
 	std::unique_ptr<VulkanLearn::VLPipeline> AppPipeline;
+	// Evicts standalone models when the heap runs low, declared before the models registered with it
+	std::unique_ptr<VulkanLearn::VLResidencyManager> ResidencyManager;
+	// Shared geometry buffers, declared before the models that live in them
+	std::unique_ptr<VulkanLearn::VLMeshPool> MeshPool;
 	std::unique_ptr<VulkanLearn::VLModel> AppModel;
+	// Cell of the background grid, a standalone model the residency manager may evict
+	std::unique_ptr<VulkanLearn::VLModel> BackgroundModel;
+	// One per frame in flight: command buffer, transient data (uniforms, dynamic vertices, indirect arguments)
+	// and descriptor sets of that frame
+	std::vector<std::unique_ptr<VulkanLearn::VLFrameContext>> FrameContexts;
+	// Records the draws into secondary command buffers on all cores
+	std::unique_ptr<VulkanLearn::VLParallelRecorder> DrawRecorder;
+	// Draws of the frame, sorted to skip repeated pipeline and geometry binds
+	VulkanLearn::VLRenderQueue RenderQueue;
+	// Commands of the frame, one stream per recording slice. Each slice produces its part of the render queue into
+	// its own stream and translates that to Vulkan calls afterwards.
+	std::vector<std::unique_ptr<VulkanLearn::VLCommandStream>> SliceCommands;
+	// Static grid behind the moving triangles, only re-recorded when the pipeline or swap chain changes
+	std::unique_ptr<VulkanLearn::VLMappedBuffer> BackgroundInstances;
+	std::unique_ptr<VulkanLearn::VLRenderLayer> BackgroundLayer;
 	VkPipelineLayout PipelineLayout;
-	std::vector<VkCommandBuffer> CommandBuffers;
+	// Frames drawn since the start, statistics are reported every StatisticsInterval frames
+	uint64_t FrameCount = 0;
+	// Summed over the frames since the last report
+	struct ReportCounters
+	{
+		uint64_t Draws = 0;
+		uint64_t SavedBinds = 0;
+		// Calls of the recorders that replay the frame, summed up from the recording threads
+		std::atomic<uint64_t> IssuedCalls{ 0 };
+		std::atomic<uint64_t> SkippedCalls{ 0 };
+	};
+	ReportCounters Counters;
 
 
 };
\ No newline at end of file
@@ -1,3 +1,5 @@
 "C:\Program Files\VulkanSDK\1.3.261.1\Bin\glslc.exe" -x glsl TestShader.vert -o TestShader.vert.spv
 "C:\Program Files\VulkanSDK\1.3.261.1\Bin\glslc.exe" TestShader.frag -o TestShader.frag.spv
+"C:\Program Files\VulkanSDK\1.3.261.1\Bin\glslc.exe" -x glsl InstancedShader.vert -o InstancedShader.vert.spv
+"C:\Program Files\VulkanSDK\1.3.261.1\Bin\glslc.exe" InstancedShader.frag -o InstancedShader.frag.spv
 pause
\ No newline at end of file
@@ -0,0 +1,9 @@
+#version 450
+
+layout (location = 0) in vec3 fragColor;
+
+layout (location = 0) out vec4 OutColor;
+
+void main() {
+	OutColor = vec4(fragColor, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec3 color;
+
+// Per-instance stream, advanced once per instance
+layout(location = 2) in vec2 instanceTransformColumn0;
+layout(location = 3) in vec2 instanceTransformColumn1;
+layout(location = 4) in vec2 instanceOffset;
+layout(location = 5) in vec3 instanceColor;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    mat2 transform = mat2(instanceTransformColumn0, instanceTransformColumn1);
+    gl_Position = vec4(transform * position + instanceOffset, 0.0, 1.0);
+    fragColor = instanceColor;
+}
\ No newline at end of file
@@ -3,10 +3,16 @@
 #include <stdexcept>
 #include <array>
 
+// Capacity of the shared geometry buffers, a dimension 8 triangle alone takes 3^9 vertices
+static constexpr VkDeviceSize MeshPoolVertexCount = 256 * 1024;
+static constexpr VkDeviceSize MeshPoolIndexCount = 0;
+static constexpr uint32_t MaxDrawCount = 64;
 
 SierpinskiTriangleApp::SierpinskiTriangleApp()
 {
 	LoadModels();
+	// Upload all vertex data in a single batch
+	AppDevice.GetUploadEngine().Submit();
 	CreatePipelineLayout();
 	RecreateSwapChain();
 	CreateCommandBuffers();
@@ -14,7 +20,8 @@ SierpinskiTriangleApp::SierpinskiTriangleApp()
 
 SierpinskiTriangleApp::~SierpinskiTriangleApp()
 {
-	vkDestroyPipelineLayout(AppDevice.GetDevice(), PipelineLayout, nullptr);
+	vkDestroyPipelineLayout(AppDevice.GetDevice(), PipelineLayout,
+		AppDevice.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline));
 }
 
 void SierpinskiTriangleApp::run()
@@ -64,7 +71,13 @@ void SierpinskiTriangleApp::LoadModels()
 {
 	std::vector<VLModel::Vertex> vertices = GetSierpinskiVertices(8);
 
-	AppModel = std::make_unique<VLModel>(AppDevice, vertices);
+	MeshPool = std::make_unique<VLMeshPool>(AppDevice, MeshPoolVertexCount, sizeof(VLModel::Vertex), MeshPoolIndexCount);
+	AppModel = std::make_unique<VLModel>(AppDevice, *MeshPool, vertices);
+
+	DrawList = std::make_unique<VLIndirectDrawList>(AppDevice, MaxDrawCount);
+	DrawList->Add(*AppModel);
+	DrawList->Upload();
+	InvalidateCommandBuffers();
 }
 
 void SierpinskiTriangleApp::CreatePipelineLayout()
@@ -77,7 +90,8 @@ void SierpinskiTriangleApp::CreatePipelineLayout()
 	// Can be used to Efficiently send a small amount of data to our shader programs
 	pipelineLayoutInfo.pushConstantRangeCount = 0;
 	pipelineLayoutInfo.pPushConstantRanges = nullptr;
-	if (vkCreatePipelineLayout(AppDevice.GetDevice(), &pipelineLayoutInfo, nullptr, &PipelineLayout) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(AppDevice.GetDevice(), &pipelineLayoutInfo,
+		AppDevice.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline), &PipelineLayout) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create pipeline layout!");
 	}
@@ -94,9 +108,17 @@ void SierpinskiTriangleApp::RecreateSwapChain()
 		glfwWaitEvents();
 	}
 
-	vkDeviceWaitIdle(AppDevice.GetDevice());
-	AppSwapChain.reset(nullptr);
-	AppSwapChain = std::make_unique<VLSwapChain>(AppDevice, extend);
+	// Note:	No need to wait for the device to go idle, the old swap chain and pipeline are destroyed through
+	//			the deletion queue once the frames still using them have completed
+	if (AppSwapChain == nullptr) {
+		AppSwapChain = std::make_unique<VLSwapChain>(AppDevice, extend);
+	}
+	else {
+		AppSwapChain = std::make_unique<VLSwapChain>(AppDevice, extend, std::move(AppSwapChain));
+		// The command buffers of the old images can still be pending, start over with new ones
+		FreeCommandBuffers();
+		CreateCommandBuffers();
+	}
 	// Note: Pipeline is Dependant on the swap chain
 	CreatePipeline();
 }
@@ -115,12 +137,12 @@ void SierpinskiTriangleApp::CreatePipeline()
 		"Shaders/TestShader.vert.spv",
 		"Shaders/TestShader.frag.spv",
 		pipelineConfig);
+	InvalidateCommandBuffers();
 }
 
 void SierpinskiTriangleApp::CreateCommandBuffers()
 {
-	// TODO:	For simplicity make the command buffers one-to-one in size  to the image count 
-//			to avoid rerecording the command every frame to specify the target output frame
+	// Note:	One command buffer per swap chain image, so a recorded buffer can be submitted again for its image
 	CommandBuffers.resize(AppSwapChain->GetImageCount());
 
 	VkCommandBufferAllocateInfo allocInfo{};
@@ -135,6 +157,21 @@ void SierpinskiTriangleApp::CreateCommandBuffers()
 	{
 		throw std::runtime_error("Failed to allocate command buffers!");
 	}
+	RecordedVersions.assign(CommandBuffers.size(), 0);
+}
+
+void SierpinskiTriangleApp::FreeCommandBuffers()
+{
+	// Note:	Frames in flight may still execute them
+	AppDevice.DeferDestroy([&Device = AppDevice, commandBuffers = std::move(CommandBuffers)]()
+		{
+			vkFreeCommandBuffers(
+				Device.GetDevice(),
+				Device.GetCommandPool(),
+				static_cast<uint32_t>(commandBuffers.size()),
+				commandBuffers.data());
+		});
+	CommandBuffers.clear();
 }
 
 void SierpinskiTriangleApp::DrawFrame()
@@ -153,18 +190,25 @@ void SierpinskiTriangleApp::DrawFrame()
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	RecordCommandBuffer(imageIndex);
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || AppWindow.WasWindowResized())
+	// Note:	AcquireNextImage waited for the previous submit of this image, so its command buffer isn't pending
+	if (RecordedVersions[imageIndex] != CommandBufferVersion)
 	{
-		AppWindow.ResetWindowResizedFlag();
-		RecreateSwapChain();
-		return;
+		RecordCommandBuffer(imageIndex);
+		RecordedVersions[imageIndex] = CommandBufferVersion;
 	}
 
 	// Note:	Submit to provided Graphics queue + Handle CPU and GPU synchronization
 	//			Command buffer will then be executed
 	//			Then the Swap chain will present associated attachment image view to the display
+	// Note:	Always submit once the image is acquired, recreating first would leave the image available
+	//			semaphore signaled without anything waiting on it
 	result = AppSwapChain->SubmitCommandBuffers(&CommandBuffers[imageIndex], &imageIndex);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || AppWindow.WasWindowResized())
+	{
+		AppWindow.ResetWindowResizedFlag();
+		RecreateSwapChain();
+		return;
+	}
 	if (result != VK_SUCCESS) {
 		throw std::runtime_error("Failed to present swap chain image!");
 	}
@@ -206,12 +250,14 @@ void SierpinskiTriangleApp::RecordCommandBuffer(int imageIndex)
 	viewport.minDepth = 0.0f;
 	viewport.maxDepth = 1.0f;
 	VkRect2D scissor{ {0, 0}, AppSwapChain->GetSwapChainExtent() };
-	vkCmdSetViewport(CommandBuffers[imageIndex], 0, 1, &viewport);
-	vkCmdSetScissor(CommandBuffers[imageIndex], 0, 1, &scissor);
-
-	AppPipeline->Bind(CommandBuffers[imageIndex]);
-	AppModel->Bind(CommandBuffers[imageIndex]);
-	AppModel->Draw(CommandBuffers[imageIndex]);
+	VLCommandRecorder recorder{ CommandBuffers[imageIndex] };
+	recorder.SetViewport(viewport);
+	recorder.SetScissor(scissor);
+
+	AppPipeline->Bind(recorder);
+	// Note:	All models share the buffers of the mesh pool, so geometry is bound once for every draw
+	MeshPool->Bind(recorder);
+	DrawList->Record(recorder.GetCommandBuffer());
 
 	vkCmdEndRenderPass(CommandBuffers[imageIndex]);
 	if (vkEndCommandBuffer(CommandBuffers[imageIndex]) != VK_SUCCESS)
@@ -11,6 +11,8 @@
 #include "VLDevice.h"
 #include "VLSwapChain.h"
 #include "VLModel.h"
+#include "VLMeshPool.h"
+#include "VLIndirectDrawList.h"
 
 using namespace VulkanLearn;
 class SierpinskiTriangleApp {
@@ -39,14 +41,25 @@ private:
 	void RecordCommandBuffer(int imageIndex);
 	void CreatePipeline();
 	void CreateCommandBuffers();
+	void FreeCommandBuffers();
+	// Call whenever something the command buffers reference changes (pipeline, models, extent or per-draw data)
+	void InvalidateCommandBuffers() { CommandBufferVersion++; }
 
 	VLWindow AppWindow{ Width, Height, "Hello Vulkan!" };
 	VLDevice AppDevice{ AppWindow };
 	std::unique_ptr<VLSwapChain> AppSwapChain;
 	std::unique_ptr<VulkanLearn::VLPipeline> AppPipeline;
+	// Shared geometry buffers, declared before the models that live in them
+	std::unique_ptr<VulkanLearn::VLMeshPool> MeshPool;
 	std::unique_ptr<VulkanLearn::VLModel> AppModel;
+	// Draw commands of every model in the mesh pool, drawn with indirect calls
+	std::unique_ptr<VulkanLearn::VLIndirectDrawList> DrawList;
 	VkPipelineLayout PipelineLayout;
 	std::vector<VkCommandBuffer> CommandBuffers;
+	// Note:	Command buffers are recorded once and submitted again as long as nothing they reference changed.
+	//			An image whose recorded version is behind CommandBufferVersion is re-recorded before its submit.
+	uint64_t CommandBufferVersion = 1;
+	std::vector<uint64_t> RecordedVersions;
 
 
 };
\ No newline at end of file
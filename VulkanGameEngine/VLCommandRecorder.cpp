@@ -0,0 +1,150 @@
+#include "VLCommandRecorder.h"
+
+// std headers
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+namespace VulkanLearn
+{
+	void VLCommandRecorder::BindPipeline(VkPipelineBindPoint BindPoint, VkPipeline Pipeline)
+	{
+		VkPipeline& boundPipeline = BindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? ComputePipeline : GraphicsPipeline;
+		if (boundPipeline == Pipeline)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+
+		vkCmdBindPipeline(CommandBuffer, BindPoint, Pipeline);
+		boundPipeline = Pipeline;
+		Statistics.IssuedCalls++;
+
+		// Note:	A pipeline whose layout isn't compatible with the one used to push disturbs the push constants,
+		//			rather than comparing layouts the cached push is dropped on every pipeline change
+		PushLayout = VK_NULL_HANDLE;
+	}
+
+	void VLCommandRecorder::BindVertexBuffers(uint32_t FirstBinding, uint32_t BindingCount, const VkBuffer* pBuffers,
+		const VkDeviceSize* pOffsets)
+	{
+		if (FirstBinding + BindingCount > MaxCachedVertexBindings)
+		{
+			vkCmdBindVertexBuffers(CommandBuffer, FirstBinding, BindingCount, pBuffers, pOffsets);
+			Statistics.IssuedCalls++;
+			// Note:	The call still replaces the cached bindings it covers
+			for (uint32_t binding = FirstBinding; binding < MaxCachedVertexBindings; binding++)
+			{
+				VertexBuffers[binding] = pBuffers[binding - FirstBinding];
+				VertexOffsets[binding] = pOffsets[binding - FirstBinding];
+			}
+			return;
+		}
+
+		// Narrow the call down to the range of bindings that actually change
+		uint32_t first = BindingCount;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < BindingCount; i++)
+		{
+			const uint32_t binding = FirstBinding + i;
+			if (VertexBuffers[binding] != pBuffers[i] || VertexOffsets[binding] != pOffsets[i])
+			{
+				first = std::min(first, i);
+				last = i;
+				VertexBuffers[binding] = pBuffers[i];
+				VertexOffsets[binding] = pOffsets[i];
+			}
+		}
+
+		if (first == BindingCount)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+		vkCmdBindVertexBuffers(CommandBuffer, FirstBinding + first, last - first + 1, pBuffers + first, pOffsets + first);
+		Statistics.IssuedCalls++;
+	}
+
+	void VLCommandRecorder::BindIndexBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkIndexType Type)
+	{
+		if (IndexBuffer == Buffer && IndexOffset == Offset && IndexType == Type)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+
+		vkCmdBindIndexBuffer(CommandBuffer, Buffer, Offset, Type);
+		IndexBuffer = Buffer;
+		IndexOffset = Offset;
+		IndexType = Type;
+		Statistics.IssuedCalls++;
+	}
+
+	void VLCommandRecorder::SetViewport(const VkViewport& InViewport)
+	{
+		if (bViewportSet && std::memcmp(&Viewport, &InViewport, sizeof(VkViewport)) == 0)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+
+		vkCmdSetViewport(CommandBuffer, 0, 1, &InViewport);
+		Viewport = InViewport;
+		bViewportSet = true;
+		Statistics.IssuedCalls++;
+	}
+
+	void VLCommandRecorder::SetScissor(const VkRect2D& InScissor)
+	{
+		if (bScissorSet && std::memcmp(&Scissor, &InScissor, sizeof(VkRect2D)) == 0)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+
+		vkCmdSetScissor(CommandBuffer, 0, 1, &InScissor);
+		Scissor = InScissor;
+		bScissorSet = true;
+		Statistics.IssuedCalls++;
+	}
+
+	void VLCommandRecorder::PushConstants(VkPipelineLayout Layout, VkShaderStageFlags Stages, uint32_t Offset,
+		uint32_t Size, const void* pValues)
+	{
+		if (PushLayout == Layout && PushStages == Stages && PushOffset == Offset && PushSize == Size &&
+			std::memcmp(PushData, pValues, Size) == 0)
+		{
+			Statistics.SkippedCalls++;
+			return;
+		}
+
+		vkCmdPushConstants(CommandBuffer, Layout, Stages, Offset, Size, pValues);
+		Statistics.IssuedCalls++;
+
+		// Note:	Other ranges keep their values but aren't tracked, only the last push can be skipped
+		if (Size <= MaxCachedPushConstantSize)
+		{
+			PushLayout = Layout;
+			PushStages = Stages;
+			PushOffset = Offset;
+			PushSize = Size;
+			std::memcpy(PushData, pValues, Size);
+		}
+		else
+		{
+			PushLayout = VK_NULL_HANDLE;
+		}
+	}
+
+	void VLCommandRecorder::Invalidate()
+	{
+		GraphicsPipeline = VK_NULL_HANDLE;
+		ComputePipeline = VK_NULL_HANDLE;
+		std::fill(std::begin(VertexBuffers), std::end(VertexBuffers), VkBuffer(VK_NULL_HANDLE));
+		std::fill(std::begin(VertexOffsets), std::end(VertexOffsets), VkDeviceSize(0));
+		IndexBuffer = VK_NULL_HANDLE;
+		bViewportSet = false;
+		bScissorSet = false;
+		PushLayout = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "VLDevice.h"
+
+#include <cstdint>
+
+namespace VulkanLearn
+{
+	// Calls recorded through a VLCommandRecorder since it was created
+	struct VLCommandRecorderStatistics
+	{
+		uint32_t IssuedCalls = 0;
+		// Binds and state changes that matched the current state and never reached the driver
+		uint32_t SkippedCalls = 0;
+	};
+
+	// Thin wrapper around a command buffer that remembers the bound pipeline, vertex and index buffers, viewport,
+	// scissor and push constants, and drops calls that would set what is already set.
+	// Anything the wrapper doesn't cover is recorded on GetCommandBuffer() directly.
+	// Note:	Pipelines are expected to keep viewport and scissor dynamic, a pipeline with static viewport state
+	//			would overwrite them without the wrapper knowing.
+	//			Use one recorder per command buffer and recording thread, a new recorder starts with nothing cached.
+	class VLCommandRecorder
+	{
+	public:
+		explicit VLCommandRecorder(VkCommandBuffer InCommandBuffer) : CommandBuffer{ InCommandBuffer } {}
+
+		VLCommandRecorder(const VLCommandRecorder&) = delete;
+		VLCommandRecorder(VLCommandRecorder&&) = delete;
+		VLCommandRecorder& operator=(const VLCommandRecorder&) = delete;
+		VLCommandRecorder& operator=(VLCommandRecorder&&) = delete;
+
+		void BindPipeline(VkPipelineBindPoint BindPoint, VkPipeline Pipeline);
+		// Only the bindings that differ from the bound ones are recorded
+		void BindVertexBuffers(uint32_t FirstBinding, uint32_t BindingCount, const VkBuffer* pBuffers,
+			const VkDeviceSize* pOffsets);
+		void BindIndexBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkIndexType Type);
+		void SetViewport(const VkViewport& InViewport);
+		void SetScissor(const VkRect2D& InScissor);
+		// Skipped when the same bytes were pushed to the same range last
+		void PushConstants(VkPipelineLayout Layout, VkShaderStageFlags Stages, uint32_t Offset, uint32_t Size,
+			const void* pValues);
+
+		// Forgets all cached state, e.g. after vkCmdExecuteCommands which leaves the state of the primary undefined
+		void Invalidate();
+
+		VkCommandBuffer GetCommandBuffer() const { return CommandBuffer; }
+		const VLCommandRecorderStatistics& GetStatistics() const { return Statistics; }
+
+		static constexpr uint32_t MaxCachedVertexBindings = 16;
+		// Guaranteed minimum of maxPushConstantsSize, larger pushes are always recorded
+		static constexpr uint32_t MaxCachedPushConstantSize = 128;
+
+	private:
+		VkCommandBuffer CommandBuffer;
+		VLCommandRecorderStatistics Statistics{};
+
+		VkPipeline GraphicsPipeline = VK_NULL_HANDLE;
+		VkPipeline ComputePipeline = VK_NULL_HANDLE;
+
+		VkBuffer VertexBuffers[MaxCachedVertexBindings]{};
+		VkDeviceSize VertexOffsets[MaxCachedVertexBindings]{};
+
+		VkBuffer IndexBuffer = VK_NULL_HANDLE;
+		VkDeviceSize IndexOffset = 0;
+		VkIndexType IndexType = VK_INDEX_TYPE_UINT16;
+
+		bool bViewportSet = false;
+		VkViewport Viewport{};
+		bool bScissorSet = false;
+		VkRect2D Scissor{};
+
+		// Last push, compared bytewise against the next one
+		VkPipelineLayout PushLayout = VK_NULL_HANDLE;
+		VkShaderStageFlags PushStages = 0;
+		uint32_t PushOffset = 0;
+		uint32_t PushSize = 0;
+		uint8_t PushData[MaxCachedPushConstantSize]{};
+	};
+}
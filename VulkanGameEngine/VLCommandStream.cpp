@@ -0,0 +1,198 @@
+#include "VLCommandStream.h"
+
+#include "VLCommandRecorder.h"
+
+// std headers
+#include <cstring>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLCommandStream::VLCommandStream(size_t InCapacity) :
+		Arena(InCapacity)
+	{
+	}
+
+	void VLCommandStream::Reset()
+	{
+		Head = 0;
+		CommandCount = 0;
+	}
+
+	void VLCommandStream::BindPipeline(VkPipelineBindPoint BindPoint, VkPipeline Pipeline)
+	{
+		Write(VLBindPipelineCommand{ BindPoint, Pipeline });
+	}
+
+	void VLCommandStream::BindVertexBuffer(uint32_t Binding, VkBuffer Buffer, VkDeviceSize Offset)
+	{
+		Write(VLBindVertexBufferCommand{ Binding, Buffer, Offset });
+	}
+
+	void VLCommandStream::BindIndexBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkIndexType IndexType)
+	{
+		Write(VLBindIndexBufferCommand{ Buffer, Offset, IndexType });
+	}
+
+	void VLCommandStream::SetViewport(const VkViewport& Viewport)
+	{
+		Write(VLSetViewportCommand{ Viewport });
+	}
+
+	void VLCommandStream::SetScissor(const VkRect2D& Scissor)
+	{
+		Write(VLSetScissorCommand{ Scissor });
+	}
+
+	void VLCommandStream::PushConstants(VkPipelineLayout Layout, VkShaderStageFlags Stages, uint32_t Offset,
+		uint32_t Size, const void* pValues)
+	{
+		VLPushConstantsCommand& command = Write(VLPushConstantsCommand{ Layout, Stages, Offset, Size }, Size);
+		std::memcpy(&command + 1, pValues, Size);
+	}
+
+	void VLCommandStream::Draw(uint32_t VertexCount, uint32_t InstanceCount, uint32_t FirstVertex,
+		uint32_t FirstInstance)
+	{
+		Write(VLDrawCommand{ VertexCount, InstanceCount, FirstVertex, FirstInstance });
+	}
+
+	void VLCommandStream::DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex,
+		int32_t VertexOffset, uint32_t FirstInstance)
+	{
+		Write(VLDrawIndexedCommand{ IndexCount, InstanceCount, FirstIndex, VertexOffset, FirstInstance });
+	}
+
+	void VLCommandStream::Append(const VLCommandStream& Other)
+	{
+		if (Head + Other.Head > Arena.size())
+		{
+			throw std::runtime_error("command stream is full!");
+		}
+		// Note:	Sizes are relative and every command starts aligned, so the bytes can be copied as they are
+		std::memcpy(Arena.data() + Head, Other.Arena.data(), Other.Head);
+		Head += Other.Head;
+		CommandCount += Other.CommandCount;
+	}
+
+	void VLCommandStream::Replay(VLCommandRecorder& Recorder) const
+	{
+		const VkCommandBuffer commandBuffer = Recorder.GetCommandBuffer();
+
+		// Note:	A draw is held back until the next command, which it may still be merged with
+		bool bPendingDraw = false;
+		bool bPendingIndexed = false;
+		VLDrawCommand pendingDraw{};
+		VLDrawIndexedCommand pendingIndexed{};
+		auto flushDraws = [&]()
+			{
+				if (bPendingDraw)
+				{
+					vkCmdDraw(commandBuffer, pendingDraw.VertexCount, pendingDraw.InstanceCount, pendingDraw.FirstVertex,
+						pendingDraw.FirstInstance);
+					bPendingDraw = false;
+				}
+				if (bPendingIndexed)
+				{
+					vkCmdDrawIndexed(commandBuffer, pendingIndexed.IndexCount, pendingIndexed.InstanceCount,
+						pendingIndexed.FirstIndex, pendingIndexed.VertexOffset, pendingIndexed.FirstInstance);
+					bPendingIndexed = false;
+				}
+			};
+
+		ForEach([&](const VLCommandHeader& Header, const void* pPayload)
+			{
+				switch (Header.Type)
+				{
+				case VLCommandType::Draw:
+				{
+					const VLDrawCommand& draw = *static_cast<const VLDrawCommand*>(pPayload);
+					if (bPendingDraw && draw.VertexCount == pendingDraw.VertexCount &&
+						draw.FirstVertex == pendingDraw.FirstVertex &&
+						draw.FirstInstance == pendingDraw.FirstInstance + pendingDraw.InstanceCount)
+					{
+						pendingDraw.InstanceCount += draw.InstanceCount;
+						return;
+					}
+					flushDraws();
+					pendingDraw = draw;
+					bPendingDraw = true;
+					return;
+				}
+				case VLCommandType::DrawIndexed:
+				{
+					const VLDrawIndexedCommand& draw = *static_cast<const VLDrawIndexedCommand*>(pPayload);
+					if (bPendingIndexed && draw.IndexCount == pendingIndexed.IndexCount &&
+						draw.FirstIndex == pendingIndexed.FirstIndex && draw.VertexOffset == pendingIndexed.VertexOffset &&
+						draw.FirstInstance == pendingIndexed.FirstInstance + pendingIndexed.InstanceCount)
+					{
+						pendingIndexed.InstanceCount += draw.InstanceCount;
+						return;
+					}
+					flushDraws();
+					pendingIndexed = draw;
+					bPendingIndexed = true;
+					return;
+				}
+				default:
+					break;
+				}
+
+				// Every other command changes state the held back draw depends on
+				flushDraws();
+				switch (Header.Type)
+				{
+				case VLCommandType::BindPipeline:
+				{
+					const VLBindPipelineCommand& command = *static_cast<const VLBindPipelineCommand*>(pPayload);
+					Recorder.BindPipeline(command.BindPoint, command.Pipeline);
+					break;
+				}
+				case VLCommandType::BindVertexBuffer:
+				{
+					const VLBindVertexBufferCommand& command = *static_cast<const VLBindVertexBufferCommand*>(pPayload);
+					Recorder.BindVertexBuffers(command.Binding, 1, &command.Buffer, &command.Offset);
+					break;
+				}
+				case VLCommandType::BindIndexBuffer:
+				{
+					const VLBindIndexBufferCommand& command = *static_cast<const VLBindIndexBufferCommand*>(pPayload);
+					Recorder.BindIndexBuffer(command.Buffer, command.Offset, command.IndexType);
+					break;
+				}
+				case VLCommandType::SetViewport:
+					Recorder.SetViewport(static_cast<const VLSetViewportCommand*>(pPayload)->Viewport);
+					break;
+				case VLCommandType::SetScissor:
+					Recorder.SetScissor(static_cast<const VLSetScissorCommand*>(pPayload)->Scissor);
+					break;
+				case VLCommandType::PushConstants:
+				{
+					const VLPushConstantsCommand& command = *static_cast<const VLPushConstantsCommand*>(pPayload);
+					Recorder.PushConstants(command.Layout, command.Stages, command.Offset, command.Size, &command + 1);
+					break;
+				}
+				default:
+					throw std::runtime_error("unknown command in command stream!");
+				}
+			});
+		flushDraws();
+	}
+
+	void* VLCommandStream::Allocate(VLCommandType Type, size_t PayloadSize)
+	{
+		const size_t size = (HeaderSize + PayloadSize + Alignment - 1) & ~(Alignment - 1);
+		if (Head + size > Arena.size())
+		{
+			throw std::runtime_error("command stream is full!");
+		}
+
+		VLCommandHeader* pHeader = reinterpret_cast<VLCommandHeader*>(Arena.data() + Head);
+		pHeader->Type = Type;
+		pHeader->Size = static_cast<uint32_t>(size);
+		void* pPayload = Arena.data() + Head + HeaderSize;
+		Head += size;
+		CommandCount++;
+		return pPayload;
+	}
+}
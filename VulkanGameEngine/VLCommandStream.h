@@ -0,0 +1,171 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace VulkanLearn
+{
+	class VLCommandRecorder;
+
+	enum class VLCommandType : uint8_t
+	{
+		BindPipeline,
+		BindVertexBuffer,
+		BindIndexBuffer,
+		SetViewport,
+		SetScissor,
+		PushConstants,
+		Draw,
+		DrawIndexed
+	};
+
+	// Precedes every command in the stream
+	struct VLCommandHeader
+	{
+		VLCommandType Type;
+		// Bytes up to the next header, including this one, the payload and padding
+		uint32_t Size;
+	};
+
+	struct VLBindPipelineCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::BindPipeline;
+		VkPipelineBindPoint BindPoint;
+		VkPipeline Pipeline;
+	};
+
+	struct VLBindVertexBufferCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::BindVertexBuffer;
+		uint32_t Binding;
+		VkBuffer Buffer;
+		VkDeviceSize Offset;
+	};
+
+	struct VLBindIndexBufferCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::BindIndexBuffer;
+		VkBuffer Buffer;
+		VkDeviceSize Offset;
+		VkIndexType IndexType;
+	};
+
+	struct VLSetViewportCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::SetViewport;
+		VkViewport Viewport;
+	};
+
+	struct VLSetScissorCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::SetScissor;
+		VkRect2D Scissor;
+	};
+
+	// Followed by Size bytes of push constant data
+	struct VLPushConstantsCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::PushConstants;
+		VkPipelineLayout Layout;
+		VkShaderStageFlags Stages;
+		uint32_t Offset;
+		uint32_t Size;
+	};
+
+	struct VLDrawCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::Draw;
+		uint32_t VertexCount;
+		uint32_t InstanceCount;
+		uint32_t FirstVertex;
+		uint32_t FirstInstance;
+	};
+
+	struct VLDrawIndexedCommand
+	{
+		static constexpr VLCommandType Type = VLCommandType::DrawIndexed;
+		uint32_t IndexCount;
+		uint32_t InstanceCount;
+		uint32_t FirstIndex;
+		int32_t VertexOffset;
+		uint32_t FirstInstance;
+	};
+
+	// Draws recorded as plain structs into a linear arena instead of into a VkCommandBuffer, and translated into
+	// Vulkan calls in a separate pass by Replay().
+	// Producers don't need a command buffer, a pool or a device, so they can run on any thread (one stream per
+	// thread) and recording logic can be tested and benchmarked without a GPU.
+	// Note:	The arena is allocated once, Reset() only rewinds it. Running out of space throws instead of growing.
+	//			Replay() merges consecutive draws of the same range whose instances follow each other into one
+	//			instanced draw, and records through a VLCommandRecorder so repeated state is dropped as well.
+	class VLCommandStream
+	{
+	public:
+		explicit VLCommandStream(size_t InCapacity);
+
+		VLCommandStream(const VLCommandStream&) = delete;
+		VLCommandStream(VLCommandStream&&) = delete;
+		VLCommandStream& operator=(const VLCommandStream&) = delete;
+		VLCommandStream& operator=(VLCommandStream&&) = delete;
+
+		void Reset();
+
+		void BindPipeline(VkPipelineBindPoint BindPoint, VkPipeline Pipeline);
+		void BindVertexBuffer(uint32_t Binding, VkBuffer Buffer, VkDeviceSize Offset = 0);
+		void BindIndexBuffer(VkBuffer Buffer, VkDeviceSize Offset, VkIndexType IndexType);
+		void SetViewport(const VkViewport& Viewport);
+		void SetScissor(const VkRect2D& Scissor);
+		// The data is copied into the stream
+		void PushConstants(VkPipelineLayout Layout, VkShaderStageFlags Stages, uint32_t Offset, uint32_t Size,
+			const void* pValues);
+		void Draw(uint32_t VertexCount, uint32_t InstanceCount, uint32_t FirstVertex, uint32_t FirstInstance);
+		void DrawIndexed(uint32_t IndexCount, uint32_t InstanceCount, uint32_t FirstIndex, int32_t VertexOffset,
+			uint32_t FirstInstance);
+
+		// Copies the commands of Other behind the ones of this stream, e.g. to join the streams of several threads
+		void Append(const VLCommandStream& Other);
+
+		// Translates the commands into Vulkan calls on the command buffer of Recorder
+		void Replay(VLCommandRecorder& Recorder) const;
+
+		// Calls Visit(const VLCommandHeader&, const void* pPayload) for every command in order
+		template<typename Function>
+		void ForEach(Function&& Visit) const
+		{
+			for (size_t offset = 0; offset < Head; )
+			{
+				const VLCommandHeader* pHeader = reinterpret_cast<const VLCommandHeader*>(Arena.data() + offset);
+				Visit(*pHeader, Arena.data() + offset + HeaderSize);
+				offset += pHeader->Size;
+			}
+		}
+
+		uint32_t GetCommandCount() const { return CommandCount; }
+		size_t GetUsedBytes() const { return Head; }
+		size_t GetCapacity() const { return Arena.size(); }
+
+	private:
+		// Reserves a command with ExtraSize bytes behind its payload and returns the payload
+		void* Allocate(VLCommandType Type, size_t PayloadSize);
+
+		template<typename T>
+		T& Write(const T& Command, size_t ExtraSize = 0)
+		{
+			static_assert(alignof(T) <= Alignment, "Commands are aligned to 8 bytes at most");
+			T* pCommand = static_cast<T*>(Allocate(T::Type, sizeof(T) + ExtraSize));
+			*pCommand = Command;
+			return *pCommand;
+		}
+
+		// Note:	Every header and payload starts at a multiple of 8, which covers the 64-bit handles and sizes
+		static constexpr size_t Alignment = 8;
+		static constexpr size_t HeaderSize = (sizeof(VLCommandHeader) + Alignment - 1) & ~(Alignment - 1);
+
+		std::vector<uint8_t> Arena;
+		size_t Head = 0;
+		uint32_t CommandCount = 0;
+	};
+}
@@ -1,6 +1,10 @@
 #include "VLDevice.h"
+#include "VLUploadEngine.h"
 
 // std headers
+#include <algorithm>
+#include <bitset>
+#include <cassert>
 #include <cstring>
 #include <iostream>
 #include <set>
@@ -67,23 +71,45 @@ namespace VulkanLearn
 		PickPhysicalDevice();
 		// Select what features of our physical device we will use
 		CreateLogicalDevice();
+		// One counter for the progress of all frames, when the device supports timeline semaphores
+		CreateFrameTimeline();
+		// Reserve device memory in large blocks that buffers and images are sub-allocated from
+		CreateMemoryAllocator();
 		// Setup Command Pool for Command Buffer allocation
 		CreateCommandPool();
+		// Buffer copies run on the dedicated transfer queue when there is one
+		CreateUploadEngine();
 	}
 
 	VLDevice::~VLDevice()
 	{
+		// Owners are gone, run everything that still waits on a frame
+		vkDeviceWaitIdle(Device);
+		CompleteFrame(CurrentFrameNumber);
+
+		UploadEngine.reset();
+		DestroySingleTimeCommands();
+		if (FrameTimeline != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(Device, FrameTimeline, GetAllocationCallbacks(VLHostAllocationCategory::Device));
+		}
 		// Note:	All buffers allocated within the pool will automatically be destroyed
-		vkDestroyCommandPool(Device, CommandPool, nullptr);
-		vkDestroyDevice(Device, nullptr);
+		vkDestroyCommandPool(Device, CommandPool, GetAllocationCallbacks(VLHostAllocationCategory::Device));
+		MemoryAllocator.reset();
+		vkDestroyDevice(Device, GetAllocationCallbacks(VLHostAllocationCategory::Device));
 
 		if (EnableValidationLayers)
 		{
-			DestroyDebugUtilsMessengerEXT(Instance, DebugMessenger, nullptr);
+			DestroyDebugUtilsMessengerEXT(
+				Instance, DebugMessenger, GetAllocationCallbacks(VLHostAllocationCategory::Instance));
 		}
 
 		vkDestroySurfaceKHR(Instance, Surface, nullptr);
-		vkDestroyInstance(Instance, nullptr);
+		if (EnableHostAllocationTracking)
+		{
+			HostAllocator.LogStatistics();
+		}
+		vkDestroyInstance(Instance, GetAllocationCallbacks(VLHostAllocationCategory::Instance));
 	}
 
 	void VLDevice::CreateInstance()
@@ -106,6 +132,13 @@ namespace VulkanLearn
 		createInfo.pApplicationInfo = &appInfo;
 
 		std::vector<const char*> Extensions = GetRequiredExtensions();
+		// Needed to query the memory budget of a device, core since Vulkan 1.1
+		bPhysicalDeviceProperties2Supported =
+			IsInstanceExtensionAvailable(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		if (bPhysicalDeviceProperties2Supported)
+		{
+			Extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		}
 		createInfo.enabledExtensionCount = static_cast<uint32_t>(Extensions.size());
 		createInfo.ppEnabledExtensionNames = Extensions.data();
 
@@ -124,7 +157,8 @@ namespace VulkanLearn
 			createInfo.pNext = nullptr;
 		}
 
-		if (vkCreateInstance(&createInfo, nullptr, &Instance) != VK_SUCCESS) {
+		const VkAllocationCallbacks* pAllocator = GetAllocationCallbacks(VLHostAllocationCategory::Instance);
+		if (vkCreateInstance(&createInfo, pAllocator, &Instance) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create instance!");
 		}
 
@@ -159,6 +193,76 @@ namespace VulkanLearn
 
 		vkGetPhysicalDeviceProperties(PhysicalDevice, &DeviceProperties);
 		std::cout << "physical device: " << DeviceProperties.deviceName << std::endl;
+
+		vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &MemoryProperties);
+		for (uint32_t i = 0; i < MemoryProperties.memoryHeapCount; i++)
+		{
+			HeapBudgets[i].Budget = MemoryProperties.memoryHeaps[i].size;
+		}
+
+		// Note:	Discrete GPUs can expose a small device local + host visible heap (BAR) as well, but only on
+		//			integrated GPUs all of the device memory is shared with the host and writing it directly is free
+		const bool bIntegrated = DeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+			DeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+		const VkMemoryPropertyFlags unifiedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount && bIntegrated; i++)
+		{
+			if ((MemoryProperties.memoryTypes[i].propertyFlags & unifiedFlags) == unifiedFlags)
+			{
+				bUnifiedMemory = true;
+			}
+		}
+
+		bMemoryBudgetSupported = bPhysicalDeviceProperties2Supported &&
+			IsDeviceExtensionAvailable(PhysicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (bMemoryBudgetSupported)
+		{
+			EnabledOptionalDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+			pfnGetPhysicalDeviceMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)vkGetInstanceProcAddr(
+				Instance,
+				"vkGetPhysicalDeviceMemoryProperties2KHR");
+			bMemoryBudgetSupported = pfnGetPhysicalDeviceMemoryProperties2 != nullptr;
+		}
+		std::cout << "memory budget: " << (bMemoryBudgetSupported ? "VK_EXT_memory_budget" : "heap size estimate")
+			<< std::endl;
+
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(PhysicalDevice, &supportedFeatures);
+		bMultiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+		bDrawIndirectFirstInstanceSupported = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+		bDrawIndirectCountExtension =
+			IsDeviceExtensionAvailable(PhysicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		if (bDrawIndirectCountExtension)
+		{
+			EnabledOptionalDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+
+		// Note:	Core since Vulkan 1.2, the extension keeps the engine on a 1.0 instance. Having the extension
+		//			isn't enough, the timelineSemaphore feature has to be queried through vkGetPhysicalDeviceFeatures2.
+		if (bPhysicalDeviceProperties2Supported &&
+			IsDeviceExtensionAvailable(PhysicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+		{
+			auto pfnGetPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(
+				Instance,
+				"vkGetPhysicalDeviceFeatures2KHR");
+			if (pfnGetPhysicalDeviceFeatures2 != nullptr)
+			{
+				VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+				timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+				VkPhysicalDeviceFeatures2KHR features2{};
+				features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+				features2.pNext = &timelineFeatures;
+				pfnGetPhysicalDeviceFeatures2(PhysicalDevice, &features2);
+				bTimelineSemaphoreExtension = timelineFeatures.timelineSemaphore == VK_TRUE;
+			}
+		}
+		if (bTimelineSemaphoreExtension)
+		{
+			EnabledOptionalDeviceExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		}
+		std::cout << "frame synchronization: " << (bTimelineSemaphoreExtension ? "timeline semaphore" : "fences")
+			<< std::endl;
 	}
 
 	void VLDevice::CreateLogicalDevice()
@@ -167,6 +271,10 @@ namespace VulkanLearn
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 		std::set<uint32_t> uniqueQueueFamilies = { Indices.GraphicsFamily.value(), Indices.PresentationFamily.value() };
+		if (Indices.TransferFamily.has_value())
+		{
+			uniqueQueueFamilies.insert(Indices.TransferFamily.value());
+		}
 
 		// Priority value between 0.0f and 1.0f
 		float QueuePriority = 1.0f;
@@ -182,6 +290,8 @@ namespace VulkanLearn
 
 		VkPhysicalDeviceFeatures deviceFeatures = {};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.multiDrawIndirect = bMultiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
+		deviceFeatures.drawIndirectFirstInstance = bDrawIndirectFirstInstanceSupported ? VK_TRUE : VK_FALSE;
 
 		VkDeviceCreateInfo createInfo = {};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -190,8 +300,22 @@ namespace VulkanLearn
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
 		createInfo.pEnabledFeatures = &deviceFeatures;
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(DeviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = DeviceExtensions.data();
+
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		if (bTimelineSemaphoreExtension)
+		{
+			createInfo.pNext = &timelineFeatures;
+		}
+
+		std::vector<const char*> enabledExtensions = DeviceExtensions;
+		enabledExtensions.insert(
+			enabledExtensions.end(),
+			EnabledOptionalDeviceExtensions.begin(),
+			EnabledOptionalDeviceExtensions.end());
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		// might not really be necessary anymore because device specific validation layers
 		// have been deprecated. Added for backwards-compatibility.
@@ -205,12 +329,64 @@ namespace VulkanLearn
 			createInfo.enabledLayerCount = 0;
 		}
 
-		if (vkCreateDevice(PhysicalDevice, &createInfo, nullptr, &Device) != VK_SUCCESS) {
+		const VkAllocationCallbacks* pAllocator = GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		if (vkCreateDevice(PhysicalDevice, &createInfo, pAllocator, &Device) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create logical device!");
 		}
 
 		vkGetDeviceQueue(Device, Indices.GraphicsFamily.value(), 0, &GraphicsQueue);
 		vkGetDeviceQueue(Device, Indices.PresentationFamily.value(), 0, &PresentationQueue);
+		if (Indices.TransferFamily.has_value())
+		{
+			vkGetDeviceQueue(Device, Indices.TransferFamily.value(), 0, &TransferQueue);
+		}
+		else
+		{
+			TransferQueue = GraphicsQueue;
+		}
+
+		if (bDrawIndirectCountExtension)
+		{
+			pfnCmdDrawIndirectCount = (PFN_vkCmdDrawIndirectCountKHR)vkGetDeviceProcAddr(
+				Device, "vkCmdDrawIndirectCountKHR");
+			pfnCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(
+				Device, "vkCmdDrawIndexedIndirectCountKHR");
+			if (pfnCmdDrawIndexedIndirectCount == nullptr)
+			{
+				pfnCmdDrawIndirectCount = nullptr;
+			}
+		}
+
+		if (bTimelineSemaphoreExtension)
+		{
+			pfnWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(Device, "vkWaitSemaphoresKHR");
+			pfnGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(
+				Device, "vkGetSemaphoreCounterValueKHR");
+			bTimelineSemaphoreExtension = pfnWaitSemaphores != nullptr && pfnGetSemaphoreCounterValue != nullptr;
+		}
+	}
+
+	void VLDevice::CreateFrameTimeline()
+	{
+		if (!bTimelineSemaphoreExtension)
+		{
+			return;
+		}
+
+		// Note:	Starts at 0, which is the completed frame number before the first frame (1) is submitted
+		VkSemaphoreTypeCreateInfoKHR typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		typeInfo.initialValue = CompletedFrameNumber;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+		if (vkCreateSemaphore(Device, &semaphoreInfo, GetAllocationCallbacks(VLHostAllocationCategory::Device),
+			&FrameTimeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame timeline semaphore!");
+		}
 	}
 
 	void VLDevice::CreateCommandPool()
@@ -223,9 +399,50 @@ namespace VulkanLearn
 		poolInfo.flags =
 			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-		if (vkCreateCommandPool(Device, &poolInfo, nullptr, &CommandPool) != VK_SUCCESS) {
+		const VkAllocationCallbacks* pAllocator = GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		if (vkCreateCommandPool(Device, &poolInfo, pAllocator, &CommandPool) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create command pool!");
 		}
+
+		// Note:	Single time command buffers are reset one by one when they are recycled
+		if (vkCreateCommandPool(Device, &poolInfo, pAllocator, &SingleTimeCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create single time command pool!");
+		}
+	}
+
+	void VLDevice::DestroySingleTimeCommands()
+	{
+		const VkAllocationCallbacks* pAllocator = GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		for (std::vector<SingleTimeCommand>* pCommands : { &FreeSingleTimeCommands, &ActiveSingleTimeCommands })
+		{
+			for (SingleTimeCommand& command : *pCommands)
+			{
+				vkDestroyFence(Device, command.Fence, pAllocator);
+			}
+			pCommands->clear();
+		}
+		// Note:	Frees the command buffers as well
+		vkDestroyCommandPool(Device, SingleTimeCommandPool, pAllocator);
+	}
+
+	void VLDevice::CreateUploadEngine()
+	{
+		UploadEngine = std::make_unique<VLUploadEngine>(*this);
+	}
+
+	void VLDevice::CreateMemoryAllocator()
+	{
+		MemoryAllocator = std::make_unique<VLMemoryAllocator>(
+			Device,
+			MemoryProperties,
+			DeviceProperties.limits.bufferImageGranularity,
+			DeviceProperties.limits.nonCoherentAtomSize,
+			GetAllocationCallbacks(VLHostAllocationCategory::Device));
+
+		if (bMemoryBudgetSupported)
+		{
+			UpdateMemoryBudget();
+		}
 	}
 
 	void VLDevice::CreateSurface() { Window.CreateWindowSufrace(Instance, &Surface); }
@@ -269,7 +486,8 @@ namespace VulkanLearn
 		if (!EnableValidationLayers) return;
 		VkDebugUtilsMessengerCreateInfoEXT createInfo;
 		PopulateDebugMessengerCreateInfo(createInfo);
-		if (CreateDebugUtilsMessengerEXT(Instance, &createInfo, nullptr, &DebugMessenger) != VK_SUCCESS) {
+		const VkAllocationCallbacks* pAllocator = GetAllocationCallbacks(VLHostAllocationCategory::Instance);
+		if (CreateDebugUtilsMessengerEXT(Instance, &createInfo, pAllocator, &DebugMessenger) != VK_SUCCESS) {
 			throw std::runtime_error("failed to set up debug messenger!");
 		}
 	}
@@ -346,6 +564,40 @@ namespace VulkanLearn
 		}
 	}
 
+	bool VLDevice::IsInstanceExtensionAvailable(const char* ExtensionName)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(ExtensionName, extension.extensionName) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool VLDevice::IsDeviceExtensionAvailable(VkPhysicalDevice Device, const char* ExtensionName)
+	{
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(Device, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(Device, nullptr, &extensionCount, extensions.data());
+
+		for (const auto& extension : extensions)
+		{
+			if (strcmp(ExtensionName, extension.extensionName) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
 	bool VLDevice::CheckDeviceExtensionSupport(VkPhysicalDevice Device)
 	{
 		uint32_t extensionCount;
@@ -399,6 +651,25 @@ namespace VulkanLearn
 			i++;
 		}
 
+		// Note:	Prefer a pure transfer family (DMA engine) over an async compute family that can transfer as well
+		int bestTransferScore = 0;
+		for (uint32_t family = 0; family < queueFamilyCount; family++)
+		{
+			const VkQueueFlags flags = queueFamilies[family].queueFlags;
+			if (queueFamilies[family].queueCount == 0 || !(flags & VK_QUEUE_TRANSFER_BIT) ||
+				(flags & VK_QUEUE_GRAPHICS_BIT))
+			{
+				continue;
+			}
+
+			const int score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+			if (score > bestTransferScore)
+			{
+				indices.TransferFamily = family;
+				bestTransferScore = score;
+			}
+		}
+
 		return indices;
 	}
 
@@ -451,20 +722,108 @@ namespace VulkanLearn
 		throw std::runtime_error("failed to find supported format!");
 	}
 
-	uint32_t VLDevice::FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags deviceProperties)
+	uint32_t VLDevice::FindMemoryType(
+		uint32_t typeFilter,
+		VkMemoryPropertyFlags Required,
+		VkMemoryPropertyFlags Preferred,
+		VkMemoryPropertyFlags Avoided,
+		VkDeviceSize Size)
 	{
-		VkPhysicalDeviceMemoryProperties memProperties;
-		vkGetPhysicalDeviceMemoryProperties(PhysicalDevice, &memProperties);
-		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
+		if (bMemoryBudgetSupported && ++AllocationsSinceBudgetQuery >= BudgetQueryInterval)
+		{
+			UpdateMemoryBudget();
+		}
+
+		uint32_t bestType = UINT32_MAX;
+		uint32_t bestCost = UINT32_MAX;
+		for (uint32_t i = 0; i < MemoryProperties.memoryTypeCount; i++)
 		{
-			if ((typeFilter & (1 << i)) &&
-				(memProperties.memoryTypes[i].propertyFlags & deviceProperties) == deviceProperties)
+			const VkMemoryPropertyFlags flags = MemoryProperties.memoryTypes[i].propertyFlags;
+			if (!(typeFilter & (1 << i)) || (flags & Required) != Required)
+			{
+				continue;
+			}
+
+			// Note:	Every missing preferred flag or present avoided flag costs one point. A heap that would go
+			//			over its budget costs more than any combination of flags, so it is only picked if nothing
+			//			else is left (e.g. evicting to system memory instead of failing outright).
+			uint32_t cost = static_cast<uint32_t>(std::bitset<32>(Preferred & ~flags).count() +
+				std::bitset<32>(Avoided & flags).count());
+			const VLHeapBudget budget = GetHeapBudget(MemoryProperties.memoryTypes[i].heapIndex);
+			if (budget.Usage + Size > budget.Budget)
 			{
-				return i;
+				cost += 64;
 			}
+
+			if (cost < bestCost)
+			{
+				bestType = i;
+				bestCost = cost;
+			}
+		}
+
+		if (bestType == UINT32_MAX)
+		{
+			throw std::runtime_error("failed to find suitable memory type!");
+		}
+		return bestType;
+	}
+
+	VLHeapBudget VLDevice::GetHeapBudget(uint32_t HeapIndex)
+	{
+		// Note:	Between two driver queries, track the growth of our own blocks on top of the reported usage.
+		//			Without the extension that growth is all we know, and the budget is estimated at 80% of the heap
+		//			as the OS and other processes need their share too.
+		VLHeapBudget budget = HeapBudgets[HeapIndex];
+		const VkDeviceSize blockBytes = MemoryAllocator ? MemoryAllocator->GetHeapBlockBytes(HeapIndex) : 0;
+		if (bMemoryBudgetSupported)
+		{
+			if (blockBytes > HeapBlockBytesAtBudgetQuery[HeapIndex])
+			{
+				budget.Usage += blockBytes - HeapBlockBytesAtBudgetQuery[HeapIndex];
+			}
+		}
+		else
+		{
+			budget.Usage = blockBytes;
+			budget.Budget = MemoryProperties.memoryHeaps[HeapIndex].size * 8 / 10;
+		}
+		return budget;
+	}
+
+	void VLDevice::UpdateMemoryBudget()
+	{
+		AllocationsSinceBudgetQuery = 0;
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+		budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memoryProperties2{};
+		memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memoryProperties2.pNext = &budgetProperties;
+		pfnGetPhysicalDeviceMemoryProperties2(PhysicalDevice, &memoryProperties2);
+
+		for (uint32_t i = 0; i < MemoryProperties.memoryHeapCount; i++)
+		{
+			HeapBudgets[i].Usage = budgetProperties.heapUsage[i];
+			HeapBudgets[i].Budget = budgetProperties.heapBudget[i];
+			HeapBlockBytesAtBudgetQuery[i] = MemoryAllocator ? MemoryAllocator->GetHeapBlockBytes(i) : 0;
 		}
+	}
 
-		throw std::runtime_error("failed to find suitable memory type!");
+	VkMemoryPropertyFlags VLDevice::GetDefaultAvoidedProperties(
+		VkMemoryPropertyFlags Required, VkMemoryPropertyFlags Preferred) const
+	{
+		// Note:	Keep device only resources out of host visible types when possible, those are either the scarce
+		//			BAR heap on discrete GPUs or come at no benefit. Lazily allocated memory can only back transient
+		//			attachments, protected memory needs a protected queue.
+		const VkMemoryPropertyFlags wanted = Required | Preferred;
+		VkMemoryPropertyFlags avoided = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT;
+		if (!(wanted & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			avoided |= VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		}
+		return avoided & ~wanted;
 	}
 
 	void VLDevice::CreateBuffer(
@@ -472,7 +831,9 @@ namespace VulkanLearn
 		VkBufferUsageFlags usage,
 		VkMemoryPropertyFlags deviceProperties,
 		VkBuffer& Buffer,
-		VkDeviceMemory& BufferMemory)
+		VLAllocation& BufferAllocation,
+		VkMemoryPropertyFlags PreferredProperties,
+		bool bConcurrentTransfer)
 	{
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -480,47 +841,95 @@ namespace VulkanLearn
 		bufferInfo.usage = usage;
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-		if (vkCreateBuffer(Device, &bufferInfo, nullptr, &Buffer) != VK_SUCCESS) {
+		// Note:	Without a dedicated transfer family both queues are the same one and exclusive is enough
+		const QueueFamilyIndices indices = FindPhysicalQueueFamilies();
+		uint32_t queueFamilies[2] = { indices.GraphicsFamily.value(), indices.TransferFamily.value_or(0) };
+		if (bConcurrentTransfer && indices.TransferFamily.has_value() && queueFamilies[1] != queueFamilies[0])
+		{
+			bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = 2;
+			bufferInfo.pQueueFamilyIndices = queueFamilies;
+		}
+
+		if (vkCreateBuffer(Device, &bufferInfo, GetAllocationCallbacks(VLHostAllocationCategory::Device), &Buffer) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create vertex buffer!");
 		}
 
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(Device, Buffer, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, deviceProperties);
+		BufferAllocation = AllocateMemory(memRequirements, deviceProperties, PreferredProperties, true);
 
-		if (vkAllocateMemory(Device, &allocInfo, nullptr, &BufferMemory) != VK_SUCCESS)
+		if (vkBindBufferMemory(Device, Buffer, BufferAllocation.Memory, BufferAllocation.Offset) != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to allocate vertex buffer memory!");
+			throw std::runtime_error("failed to bind buffer memory!");
 		}
-
-		vkBindBufferMemory(Device, Buffer, BufferMemory, 0);
 	}
 
 	VkCommandBuffer VLDevice::BeginSingleTimeCommands()
 	{
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandPool = CommandPool;
-		allocInfo.commandBufferCount = 1;
+		// Give back every submitted buffer whose fence has signalled
+		for (size_t i = 0; i < ActiveSingleTimeCommands.size();)
+		{
+			SingleTimeCommand& command = ActiveSingleTimeCommands[i];
+			if (command.bSubmitted && vkGetFenceStatus(Device, command.Fence) == VK_SUCCESS)
+			{
+				FreeSingleTimeCommands.push_back(command);
+				ActiveSingleTimeCommands[i] = ActiveSingleTimeCommands.back();
+				ActiveSingleTimeCommands.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		SingleTimeCommand command{};
+		if (!FreeSingleTimeCommands.empty())
+		{
+			command = FreeSingleTimeCommands.back();
+			FreeSingleTimeCommands.pop_back();
+			vkResetFences(Device, 1, &command.Fence);
+			vkResetCommandBuffer(command.CommandBuffer, 0);
+		}
+		else
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = SingleTimeCommandPool;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(Device, &allocInfo, &command.CommandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate single time command buffer!");
+			}
 
-		VkCommandBuffer commandBuffer;
-		vkAllocateCommandBuffers(Device, &allocInfo, &commandBuffer);
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(Device, &fenceInfo, GetAllocationCallbacks(VLHostAllocationCategory::Device),
+				&command.Fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create single time command fence!");
+			}
+		}
+		command.bSubmitted = false;
+		ActiveSingleTimeCommands.push_back(command);
 
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		vkBeginCommandBuffer(commandBuffer, &beginInfo);
-		return commandBuffer;
+		vkBeginCommandBuffer(command.CommandBuffer, &beginInfo);
+		return command.CommandBuffer;
 	}
 
-	void VLDevice::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+	void VLDevice::EndSingleTimeCommands(VkCommandBuffer commandBuffer, bool bWait)
 	{
+		auto it = std::find_if(ActiveSingleTimeCommands.begin(), ActiveSingleTimeCommands.end(),
+			[commandBuffer](const SingleTimeCommand& Command) { return Command.CommandBuffer == commandBuffer; });
+		assert(it != ActiveSingleTimeCommands.end() && !it->bSubmitted &&
+			"Command buffer was not started with BeginSingleTimeCommands");
+
 		vkEndCommandBuffer(commandBuffer);
 
 		VkSubmitInfo submitInfo{};
@@ -528,60 +937,45 @@ namespace VulkanLearn
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
 
-		vkQueueSubmit(GraphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(GraphicsQueue);
+		// Note:	Waiting on the fence of this buffer only, instead of the whole queue that also runs our frames
+		if (vkQueueSubmit(GraphicsQueue, 1, &submitInfo, it->Fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit single time command buffer!");
+		}
+		it->bSubmitted = true;
 
-		vkFreeCommandBuffers(Device, CommandPool, 1, &commandBuffer);
+		if (bWait)
+		{
+			vkWaitForFences(Device, 1, &it->Fence, VK_TRUE, UINT64_MAX);
+			FreeSingleTimeCommands.push_back(*it);
+			*it = ActiveSingleTimeCommands.back();
+			ActiveSingleTimeCommands.pop_back();
+		}
 	}
 
 	void VLDevice::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 	{
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-		VkBufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;  // Optional
-		copyRegion.dstOffset = 0;  // Optional
-		copyRegion.size = size;
-		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-		EndSingleTimeCommands(commandBuffer);
+		// Note:	Blocks until the copy is done as callers free the source right after,
+		//			use the upload engine directly to batch uploads without waiting
+		UploadEngine->Wait(UploadEngine->CopyBuffer(srcBuffer, dstBuffer, size));
 	}
 
-	void VLDevice::CopyBufferToImage(
-		VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount)
+	VLUploadTicket VLDevice::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
+		uint32_t layerCount, VkImageLayout finalLayout)
 	{
-		VkCommandBuffer commandBuffer = BeginSingleTimeCommands();
-
-		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
-		region.bufferRowLength = 0;
-		region.bufferImageHeight = 0;
-
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-		region.imageSubresource.layerCount = layerCount;
-
-		region.imageOffset = { 0, 0, 0 };
-		region.imageExtent = { width, height, 1 };
-
-		vkCmdCopyBufferToImage(
-			commandBuffer,
-			buffer,
-			image,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1,
-			&region);
-		EndSingleTimeCommands(commandBuffer);
+		// Note:	Recorded into the upload engine's pending batch, the source must stay alive until the ticket has
+		//			completed and the image is in finalLayout once the graphics queue waited on it
+		return UploadEngine->CopyBufferToImage(buffer, image, width, height, layerCount, finalLayout);
 	}
 
 	void VLDevice::CreateImageWithInfo(
 		const VkImageCreateInfo& ImageInfo,
 		VkMemoryPropertyFlags deviceProperties,
 		VkImage& Image,
-		VkDeviceMemory& ImageMemory)
+		VLAllocation& ImageAllocation,
+		VkMemoryPropertyFlags PreferredProperties)
 	{
-		if (vkCreateImage(Device, &ImageInfo, nullptr, &Image) != VK_SUCCESS)
+		if (vkCreateImage(Device, &ImageInfo, GetAllocationCallbacks(VLHostAllocationCategory::Device), &Image) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create image!");
 		}
@@ -589,19 +983,212 @@ namespace VulkanLearn
 		VkMemoryRequirements memRequirements;
 		vkGetImageMemoryRequirements(Device, Image, &memRequirements);
 
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = FindMemoryType(memRequirements.memoryTypeBits, deviceProperties);
+		ImageAllocation = AllocateMemory(
+			memRequirements, deviceProperties, PreferredProperties, ImageInfo.tiling == VK_IMAGE_TILING_LINEAR);
 
-		if (vkAllocateMemory(Device, &allocInfo, nullptr, &ImageMemory) != VK_SUCCESS)
+		if (vkBindImageMemory(Device, Image, ImageAllocation.Memory, ImageAllocation.Offset) != VK_SUCCESS)
 		{
-			throw std::runtime_error("failed to allocate image memory!");
+			throw std::runtime_error("failed to bind image memory!");
 		}
+	}
 
-		if (vkBindImageMemory(Device, Image, ImageMemory, 0) != VK_SUCCESS)
+	VLAllocation VLDevice::AllocateMemory(
+		const VkMemoryRequirements& Requirements,
+		VkMemoryPropertyFlags Required,
+		VkMemoryPropertyFlags Preferred,
+		bool bLinearResource)
+	{
+		VLAllocation allocation{};
+		while (true)
 		{
-			throw std::runtime_error("failed to bind image memory!");
+			// Note:	The memory type is picked again on every attempt, after an eviction the budget of the
+			//			preferred heap may allow it again
+			const uint32_t memoryType = FindMemoryType(
+				Requirements.memoryTypeBits,
+				Required,
+				Preferred,
+				GetDefaultAvoidedProperties(Required, Preferred),
+				Requirements.size);
+			if (MemoryAllocator->TryAllocate(Requirements, memoryType, bLinearResource, allocation))
+			{
+				return allocation;
+			}
+
+			const uint32_t heapIndex = MemoryProperties.memoryTypes[memoryType].heapIndex;
+			if (!OnOutOfMemory || !OnOutOfMemory(heapIndex, Requirements.size))
+			{
+				throw std::runtime_error("failed to allocate device memory!");
+			}
+			if (bMemoryBudgetSupported)
+			{
+				UpdateMemoryBudget();
+			}
+		}
+	}
+
+	void VLDevice::CmdDrawIndirectCount(VkCommandBuffer CommandBuffer, VkBuffer Buffer, VkDeviceSize Offset,
+		VkBuffer CountBuffer, VkDeviceSize CountOffset, uint32_t MaxDrawCount, uint32_t Stride)
+	{
+		assert(IsDrawIndirectCountSupported() && "VK_KHR_draw_indirect_count is not enabled");
+		pfnCmdDrawIndirectCount(CommandBuffer, Buffer, Offset, CountBuffer, CountOffset, MaxDrawCount, Stride);
+	}
+
+	void VLDevice::CmdDrawIndexedIndirectCount(VkCommandBuffer CommandBuffer, VkBuffer Buffer, VkDeviceSize Offset,
+		VkBuffer CountBuffer, VkDeviceSize CountOffset, uint32_t MaxDrawCount, uint32_t Stride)
+	{
+		assert(IsDrawIndirectCountSupported() && "VK_KHR_draw_indirect_count is not enabled");
+		pfnCmdDrawIndexedIndirectCount(CommandBuffer, Buffer, Offset, CountBuffer, CountOffset, MaxDrawCount, Stride);
+	}
+
+	void VLDevice::FreeMemory(VLAllocation& Allocation)
+	{
+		// Note:	Pending ranges may point into the block that is about to be released
+		if (!PendingFlushRanges.empty())
+		{
+			FlushMappedMemory();
+		}
+		MemoryAllocator->Free(Allocation);
+	}
+
+	void VLDevice::DeferDestroy(std::function<void()> Destroy)
+	{
+		DeletionQueue.push_back({ CurrentFrameNumber, std::move(Destroy) });
+	}
+
+	void VLDevice::DeferDestroyBuffer(VkBuffer Buffer, VLAllocation& Allocation)
+	{
+		VLAllocation allocation = Allocation;
+		Allocation = VLAllocation{};
+		DeferDestroy([this, Buffer, allocation]() mutable
+			{
+				vkDestroyBuffer(Device, Buffer, GetAllocationCallbacks(VLHostAllocationCategory::Device));
+				FreeMemory(allocation);
+			});
+	}
+
+	void VLDevice::CompleteFrame(uint64_t FrameNumber)
+	{
+		CompletedFrameNumber = std::max(CompletedFrameNumber, FrameNumber);
+		while (!DeletionQueue.empty() && DeletionQueue.front().FrameNumber <= CompletedFrameNumber)
+		{
+			// Note:	Pop first, a destroy function may release further resources into the queue
+			std::function<void()> destroy = std::move(DeletionQueue.front().Destroy);
+			DeletionQueue.pop_front();
+			destroy();
+		}
+	}
+
+	uint64_t VLDevice::PollCompletedFrameNumber()
+	{
+		if (FrameTimeline != VK_NULL_HANDLE)
+		{
+			uint64_t value = 0;
+			if (pfnGetSemaphoreCounterValue(Device, FrameTimeline, &value) == VK_SUCCESS)
+			{
+				CompletedFrameNumber = std::max(CompletedFrameNumber, value);
+			}
+		}
+		return CompletedFrameNumber;
+	}
+
+	void VLDevice::WaitForFrame(uint64_t FrameNumber)
+	{
+		assert(FrameTimeline != VK_NULL_HANDLE && "Without timeline semaphores frames are waited for with fences");
+		if (!IsFrameComplete(FrameNumber))
+		{
+			VkSemaphoreWaitInfoKHR waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &FrameTimeline;
+			waitInfo.pValues = &FrameNumber;
+			if (pfnWaitSemaphores(Device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to wait for frame timeline semaphore!");
+			}
+		}
+		CompleteFrame(FrameNumber);
+	}
+
+	bool VLDevice::IsHostCoherent(const VLAllocation& Allocation) const
+	{
+		return MemoryProperties.memoryTypes[Allocation.MemoryTypeIndex].propertyFlags &
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	}
+
+	VkMappedMemoryRange VLDevice::GetMappedMemoryRange(
+		const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size) const
+	{
+		// Note:	The allocator aligns non-coherent allocations to whole atoms, so rounding the range outwards
+		//			never crosses into another allocation
+		const VkDeviceSize atomSize = DeviceProperties.limits.nonCoherentAtomSize;
+		const VkDeviceSize end = Size == VK_WHOLE_SIZE ? Allocation.Size : std::min(Offset + Size, Allocation.Size);
+		const VkDeviceSize alignedBegin = Offset / atomSize * atomSize;
+		const VkDeviceSize alignedEnd = std::min((end + atomSize - 1) / atomSize * atomSize, Allocation.Size);
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = Allocation.Memory;
+		range.offset = Allocation.Offset + alignedBegin;
+		range.size = alignedEnd - alignedBegin;
+		return range;
+	}
+
+	void VLDevice::QueueMappedMemoryFlush(const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size)
+	{
+		if (IsHostCoherent(Allocation) || Size == 0)
+		{
+			return;
+		}
+		PendingFlushRanges.push_back(GetMappedMemoryRange(Allocation, Offset, Size));
+	}
+
+	void VLDevice::FlushMappedMemory()
+	{
+		if (PendingFlushRanges.empty())
+		{
+			return;
+		}
+
+		// Merge overlapping and touching ranges of the same memory object, buffers tend to be written in pieces
+		std::sort(PendingFlushRanges.begin(), PendingFlushRanges.end(),
+			[](const VkMappedMemoryRange& A, const VkMappedMemoryRange& B)
+			{
+				return A.memory != B.memory ? A.memory < B.memory : A.offset < B.offset;
+			});
+		size_t mergedCount = 0;
+		for (const VkMappedMemoryRange& range : PendingFlushRanges)
+		{
+			VkMappedMemoryRange* pLast = mergedCount > 0 ? &PendingFlushRanges[mergedCount - 1] : nullptr;
+			if (pLast != nullptr && pLast->memory == range.memory && range.offset <= pLast->offset + pLast->size)
+			{
+				pLast->size = std::max(pLast->offset + pLast->size, range.offset + range.size) - pLast->offset;
+			}
+			else
+			{
+				PendingFlushRanges[mergedCount++] = range;
+			}
+		}
+		PendingFlushRanges.resize(mergedCount);
+
+		if (vkFlushMappedMemoryRanges(Device, static_cast<uint32_t>(PendingFlushRanges.size()),
+			PendingFlushRanges.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to flush mapped memory ranges!");
+		}
+		PendingFlushRanges.clear();
+	}
+
+	void VLDevice::InvalidateMappedMemory(const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size)
+	{
+		if (IsHostCoherent(Allocation) || Size == 0)
+		{
+			return;
+		}
+
+		VkMappedMemoryRange range = GetMappedMemoryRange(Allocation, Offset, Size);
+		if (vkInvalidateMappedMemoryRanges(Device, 1, &range) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to invalidate mapped memory range!");
 		}
 	}
 
@@ -1,7 +1,12 @@
 #pragma once
 
 #include "VLWindow.h"
+#include "VLMemoryAllocator.h"
+#include "VLHostAllocator.h"
 
+#include <deque>
+#include <functional>
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
@@ -23,8 +28,20 @@ namespace VulkanLearn {
 
 		std::optional<uint32_t> GraphicsFamily;
 		std::optional<uint32_t> PresentationFamily;
+		// Only set when the device has a family that can transfer but not render (DMA engine)
+		std::optional<uint32_t> TransferFamily;
 	};
 
+	// Current usage and budget of a memory heap, as reported by VK_EXT_memory_budget when available
+	struct VLHeapBudget
+	{
+		VkDeviceSize Usage = 0;
+		VkDeviceSize Budget = 0;
+	};
+
+	class VLUploadEngine;
+	struct VLUploadTicket;
+
 	class VLDevice {
 	public:
 		VLDevice(VLWindow& Window);
@@ -41,12 +58,39 @@ namespace VulkanLearn {
 		VkSurfaceKHR GetSurface() { return Surface; }
 		VkQueue GetGraphicsQueue() { return GraphicsQueue; }
 		VkQueue GetPresentQueue() { return PresentationQueue; }
+		// Equals the graphics queue when the device has no dedicated transfer family
+		VkQueue GetTransferQueue() { return TransferQueue; }
+		VLUploadEngine& GetUploadEngine() { return *UploadEngine; }
 
 		SwapChainSupportDetails GetSwapChainSupport()
 		{
 			return QuerySwapChainSupport(PhysicalDevice);
 		}
-		uint32_t FindMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+		// Returns the memory type that has all Required flags, ranked on how many Preferred flags it has and
+		// Avoided flags it lacks. Types whose heap would go over its budget by Size bytes are only used as last resort.
+		uint32_t FindMemoryType(
+			uint32_t typeFilter,
+			VkMemoryPropertyFlags Required,
+			VkMemoryPropertyFlags Preferred = 0,
+			VkMemoryPropertyFlags Avoided = 0,
+			VkDeviceSize Size = 0);
+		const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const { return MemoryProperties; }
+		VLHeapBudget GetHeapBudget(uint32_t HeapIndex);
+		bool IsMemoryBudgetSupported() const { return bMemoryBudgetSupported; }
+		// True on integrated GPUs where device local memory can be written directly by the host
+		bool IsUnifiedMemory() const { return bUnifiedMemory; }
+		// More than one draw per vkCmdDraw*Indirect call
+		bool IsMultiDrawIndirectSupported() const { return bMultiDrawIndirectSupported; }
+		// Non-zero firstInstance in indirect draw commands
+		bool IsDrawIndirectFirstInstanceSupported() const { return bDrawIndirectFirstInstanceSupported; }
+		// VK_KHR_draw_indirect_count: the number of draws is read from a buffer, so the GPU can decide it
+		bool IsDrawIndirectCountSupported() const { return pfnCmdDrawIndirectCount != nullptr; }
+		void CmdDrawIndirectCount(VkCommandBuffer CommandBuffer, VkBuffer Buffer, VkDeviceSize Offset,
+			VkBuffer CountBuffer, VkDeviceSize CountOffset, uint32_t MaxDrawCount, uint32_t Stride);
+		void CmdDrawIndexedIndirectCount(VkCommandBuffer CommandBuffer, VkBuffer Buffer, VkDeviceSize Offset,
+			VkBuffer CountBuffer, VkDeviceSize CountOffset, uint32_t MaxDrawCount, uint32_t Stride);
+		// VK_KHR_timeline_semaphore: frame completion is tracked by GetFrameTimeline() instead of per-frame fences
+		bool IsTimelineSemaphoreSupported() const { return FrameTimeline != VK_NULL_HANDLE; }
 		QueueFamilyIndices FindPhysicalQueueFamilies()
 		{
 			return FindQueueFamilies(PhysicalDevice);
@@ -55,30 +99,93 @@ namespace VulkanLearn {
 			const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags Features);
 
 		// Buffer Helper Functions
+		// bConcurrentTransfer:	shares the buffer between the graphics and the dedicated transfer family, for buffers
+		//						the upload engine writes to while the graphics queue may be reading other ranges
 		void CreateBuffer(
 			VkDeviceSize size,
 			VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties,
 			VkBuffer& Buffer,
-			VkDeviceMemory& BufferMemory);
+			VLAllocation& BufferAllocation,
+			VkMemoryPropertyFlags PreferredProperties = 0,
+			bool bConcurrentTransfer = false);
+		// One-shot command buffers for utility work (copies, layout transitions, mip generation) on the graphics queue.
+		// They come from a pool of their own and are recycled once their fence has signalled.
 		VkCommandBuffer BeginSingleTimeCommands();
-		void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
+		// bWait:	false returns right after the submit, the buffer is recycled whenever its fence has signalled
+		void EndSingleTimeCommands(VkCommandBuffer commandBuffer, bool bWait = true);
 		void CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-		void CopyBufferToImage(
-			VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layerCount);
+		// Expects the image in VK_IMAGE_LAYOUT_UNDEFINED, see VLUploadEngine::CopyBufferToImage
+		VLUploadTicket CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height,
+			uint32_t layerCount, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
 		void CreateImageWithInfo(
 			const VkImageCreateInfo& ImageInfo,
 			VkMemoryPropertyFlags properties,
 			VkImage& Image,
-			VkDeviceMemory& ImageMemory);
+			VLAllocation& ImageAllocation,
+			VkMemoryPropertyFlags PreferredProperties = 0);
+		// Returns the memory of a buffer or image created by the functions above to the allocator
+		void FreeMemory(VLAllocation& Allocation);
+		VLMemoryAllocator& GetMemoryAllocator() { return *MemoryAllocator; }
+
+		// Called when a buffer or image doesn't fit in its heap anymore. The handler releases memory of HeapIndex
+		// (e.g. by evicting resources) and returns true when the allocation should be retried.
+		using OutOfMemoryHandler = std::function<bool(uint32_t HeapIndex, VkDeviceSize Size)>;
+		void SetOutOfMemoryHandler(OutOfMemoryHandler Handler) { OnOutOfMemory = std::move(Handler); }
+
+		// Host writes to non-coherent memory only become visible to the device after a flush.
+		// Queued ranges are merged and flushed with a single call right before the frame is submitted,
+		// ranges in coherent memory are ignored.
+		void QueueMappedMemoryFlush(const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size);
+		void FlushMappedMemory();
+		// Makes device writes to non-coherent memory visible to the host, call after the writing work has completed
+		void InvalidateMappedMemory(const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size);
+		bool IsHostCoherent(const VLAllocation& Allocation) const;
+
+		// Frame-deferred destruction
+		// Note:	Frames in flight can still use a resource when its owner releases it. Instead of waiting for the
+		//			device to go idle, the destroy function is tagged with the frame being recorded and only runs
+		//			once the GPU has completed that frame.
+		void DeferDestroy(std::function<void()> Destroy);
+		// Destroys the buffer and returns its memory once the current frame has completed
+		void DeferDestroyBuffer(VkBuffer Buffer, VLAllocation& Allocation);
+		// Frame being recorded, the next one to be submitted
+		uint64_t GetCurrentFrameNumber() const { return CurrentFrameNumber; }
+		uint64_t GetCompletedFrameNumber() const { return CompletedFrameNumber; }
+		// Used by the swap chain: returns the number of the submitted frame and starts the next one
+		uint64_t SubmitFrame() { return CurrentFrameNumber++; }
+		// Used by the swap chain once the fence of a frame has signalled, runs the deletions that were waiting on it
+		void CompleteFrame(uint64_t FrameNumber);
+		// Timeline semaphore whose counter is the number of the last frame the GPU completed, every frame submit
+		// signals it with its own number. VK_NULL_HANDLE without timeline semaphore support.
+		VkSemaphore GetFrameTimeline() const { return FrameTimeline; }
+		// Reads the counter of the frame timeline without blocking. Only the completed frame number is updated,
+		// the deletions that became due run at the next CompleteFrame, so this is safe to call from anywhere.
+		// Without timeline semaphores only the frames the swap chain waited for are known to have completed.
+		uint64_t PollCompletedFrameNumber();
+		bool IsFrameComplete(uint64_t FrameNumber)
+		{
+			return FrameNumber <= CompletedFrameNumber || FrameNumber <= PollCompletedFrameNumber();
+		}
+		// Blocks until the GPU has completed FrameNumber and runs the deletions waiting on it, timeline only
+		void WaitForFrame(uint64_t FrameNumber);
 
 #ifdef NDEBUG
 		const bool EnableValidationLayers = false;
+		const bool EnableHostAllocationTracking = false;
 #else
 		const bool EnableValidationLayers = true;
+		const bool EnableHostAllocationTracking = true;
 #endif
 
+		// Callbacks to pass to the vkCreate*/vkDestroy* calls of the given category, nullptr when not tracking
+		const VkAllocationCallbacks* GetAllocationCallbacks(VLHostAllocationCategory Category) const
+		{
+			return EnableHostAllocationTracking ? HostAllocator.GetCallbacks(Category) : nullptr;
+		}
+		VLHostAllocator& GetHostAllocator() { return HostAllocator; }
+
 		VkPhysicalDeviceProperties DeviceProperties;
 
 	private:
@@ -88,6 +195,10 @@ namespace VulkanLearn {
 		void PickPhysicalDevice();
 		void CreateLogicalDevice();
 		void CreateCommandPool();
+		void DestroySingleTimeCommands();
+		void CreateMemoryAllocator();
+		void CreateUploadEngine();
+		void CreateFrameTimeline();
 
 		// helper functions
 		bool IsDeviceSuitable(VkPhysicalDevice getDevice);
@@ -98,20 +209,90 @@ namespace VulkanLearn {
 		void HasGflwRequiredInstanceExtensions();
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice getDevice);
 		SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice getDevice);
+		bool IsInstanceExtensionAvailable(const char* ExtensionName);
+		bool IsDeviceExtensionAvailable(VkPhysicalDevice getDevice, const char* ExtensionName);
+		void UpdateMemoryBudget();
+		// Flags we never want unless explicitly asked for
+		VkMemoryPropertyFlags GetDefaultAvoidedProperties(
+			VkMemoryPropertyFlags Required, VkMemoryPropertyFlags Preferred) const;
+		// Allocates memory for a resource, giving the out of memory handler a chance to make room when needed
+		VLAllocation AllocateMemory(
+			const VkMemoryRequirements& Requirements,
+			VkMemoryPropertyFlags Required,
+			VkMemoryPropertyFlags Preferred,
+			bool bLinearResource);
+		// Range relative to the allocation, rounded outwards to nonCoherentAtomSize
+		VkMappedMemoryRange GetMappedMemoryRange(
+			const VLAllocation& Allocation, VkDeviceSize Offset, VkDeviceSize Size) const;
 
+		// Note:	Declared before every Vulkan object, it has to outlive all of them
+		VLHostAllocator HostAllocator;
 		VkInstance Instance;
 		VkDebugUtilsMessengerEXT DebugMessenger;
 		VkPhysicalDevice PhysicalDevice = VK_NULL_HANDLE;
 		VLWindow& Window;
 		VkCommandPool CommandPool;
+		std::unique_ptr<VLMemoryAllocator> MemoryAllocator;
+		std::unique_ptr<VLUploadEngine> UploadEngine;
 
 		VkDevice Device;
 		VkSurfaceKHR Surface;
 		VkQueue GraphicsQueue;
 		VkQueue PresentationQueue;
+		VkQueue TransferQueue;
+
+		// Note:	Cached at PickPhysicalDevice, the memory types and heaps of a physical device never change
+		VkPhysicalDeviceMemoryProperties MemoryProperties;
+		bool bPhysicalDeviceProperties2Supported = false;
+		bool bMemoryBudgetSupported = false;
+		bool bUnifiedMemory = false;
+		bool bMultiDrawIndirectSupported = false;
+		bool bDrawIndirectFirstInstanceSupported = false;
+		bool bDrawIndirectCountExtension = false;
+		PFN_vkCmdDrawIndirectCountKHR pfnCmdDrawIndirectCount = nullptr;
+		PFN_vkCmdDrawIndexedIndirectCountKHR pfnCmdDrawIndexedIndirectCount = nullptr;
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR pfnGetPhysicalDeviceMemoryProperties2 = nullptr;
+		bool bTimelineSemaphoreExtension = false;
+		PFN_vkWaitSemaphoresKHR pfnWaitSemaphores = nullptr;
+		PFN_vkGetSemaphoreCounterValueKHR pfnGetSemaphoreCounterValue = nullptr;
+		VkSemaphore FrameTimeline = VK_NULL_HANDLE;
+		// Budget as last queried from the driver, together with our own block allocations at that moment
+		// so the usage can be estimated in between queries
+		VLHeapBudget HeapBudgets[VK_MAX_MEMORY_HEAPS];
+		VkDeviceSize HeapBlockBytesAtBudgetQuery[VK_MAX_MEMORY_HEAPS] = {};
+		uint32_t AllocationsSinceBudgetQuery = 0;
+		static constexpr uint32_t BudgetQueryInterval = 32;
+
+		std::vector<VkMappedMemoryRange> PendingFlushRanges;
+
+		struct SingleTimeCommand
+		{
+			VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+			// Unsignalled while recording or executing
+			VkFence Fence = VK_NULL_HANDLE;
+			bool bSubmitted = false;
+		};
+		// Note:	Kept apart from CommandPool so utility work never touches the pool the renderer records from
+		VkCommandPool SingleTimeCommandPool = VK_NULL_HANDLE;
+		std::vector<SingleTimeCommand> FreeSingleTimeCommands;
+		// Being recorded or submitted and not known to have completed yet
+		std::vector<SingleTimeCommand> ActiveSingleTimeCommands;
+		OutOfMemoryHandler OnOutOfMemory;
+
+		struct DeferredDestroy
+		{
+			uint64_t FrameNumber;
+			std::function<void()> Destroy;
+		};
+		// Note:	Frame numbers only go up, so the queue stays sorted and is drained from the front
+		std::deque<DeferredDestroy> DeletionQueue;
+		uint64_t CurrentFrameNumber = 1;
+		uint64_t CompletedFrameNumber = 0;
 
 		const std::vector<const char*> ValidationLayers = { "VK_LAYER_KHRONOS_validation" };
 		const std::vector<const char*> DeviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		// Extensions we use when the device has them, but can do without
+		std::vector<const char*> EnabledOptionalDeviceExtensions;
 	};
 
 }  // namespace VulkanLearn
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "VLFrameContext.h"
+
+// std headers
+#include <array>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLFrameContext::VLFrameContext(VLDevice& InDevice, VkDeviceSize RingSize, VkBufferUsageFlags RingUsage) :
+		Device{ InDevice }
+	{
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Device);
+
+		// VK_COMMAND_POOL_CREATE_TRANSIENT_BIT:	The buffers are re-recorded every frame
+		// Note:	No VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, the pool is only ever reset as a whole
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = Device.FindPhysicalQueueFamilies().GraphicsFamily.value();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(Device.GetDevice(), &poolInfo, pAllocator, &CommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = CommandPool;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &CommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate frame command buffer!");
+		}
+
+		// Note:	No VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT either, sets are released by resetting the pool
+		const std::array<VkDescriptorPoolSize, 4> poolSizes{ {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, MaxDescriptorsPerType },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, MaxDescriptorsPerType },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, MaxDescriptorsPerType },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MaxDescriptorsPerType } } };
+
+		VkDescriptorPoolCreateInfo descriptorPoolInfo{};
+		descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		descriptorPoolInfo.maxSets = MaxDescriptorSets;
+		descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		descriptorPoolInfo.pPoolSizes = poolSizes.data();
+		if (vkCreateDescriptorPool(Device.GetDevice(), &descriptorPoolInfo, pAllocator, &DescriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create frame descriptor pool!");
+		}
+
+		// A ring with a single partition, the context itself is the per-frame unit
+		Ring = std::make_unique<VLFrameRingBuffer>(Device, RingSize, 1, RingUsage);
+	}
+
+	VLFrameContext::~VLFrameContext()
+	{
+		// Note:	The last frame of this slot may still be executing, destroying the pool frees its command buffer
+		Device.DeferDestroy([&Device = Device, commandPool = CommandPool, descriptorPool = DescriptorPool]()
+			{
+				const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Device);
+				vkDestroyDescriptorPool(Device.GetDevice(), descriptorPool, pAllocator);
+				vkDestroyCommandPool(Device.GetDevice(), commandPool, pAllocator);
+			});
+	}
+
+	void VLFrameContext::Begin()
+	{
+		vkResetCommandPool(Device.GetDevice(), CommandPool, 0);
+		vkResetDescriptorPool(Device.GetDevice(), DescriptorPool, 0);
+		Ring->BeginFrame(0);
+	}
+
+	VkDescriptorSet VLFrameContext::AllocateDescriptorSet(VkDescriptorSetLayout Layout)
+	{
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = DescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &Layout;
+
+		VkDescriptorSet descriptorSet;
+		if (vkAllocateDescriptorSets(Device.GetDevice(), &allocInfo, &descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("frame descriptor pool is exhausted!");
+		}
+		return descriptorSet;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "VLDevice.h"
+#include "VLFrameRingBuffer.h"
+
+#include <memory>
+
+namespace VulkanLearn
+{
+	// Everything a single frame in flight records into and allocates from: a command pool with its primary command
+	// buffer, a transient ring buffer and a descriptor pool. Begin() resets all three at once.
+	// Note:	One context per MAX_FRAMES_IN_FLIGHT slot instead of one command buffer per swap chain image, so
+	//			nothing here depends on the swap chain and recreating it leaves the contexts alone.
+	//			Resetting a whole pool is the fast path on most drivers, resetting buffers one by one
+	//			(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT) forces the pool to track every buffer separately.
+	class VLFrameContext
+	{
+	public:
+		VLFrameContext(VLDevice& InDevice, VkDeviceSize RingSize, VkBufferUsageFlags RingUsage);
+		~VLFrameContext();
+
+		VLFrameContext(const VLFrameContext&) = delete;
+		VLFrameContext(VLFrameContext&&) = delete;
+		VLFrameContext& operator=(const VLFrameContext&) = delete;
+		VLFrameContext& operator=(VLFrameContext&&) = delete;
+
+		// Note:	Only call this once the previous frame of the slot has completed,
+		//			the command buffer, descriptor sets and ring allocations of its last frame are reused afterwards
+		void Begin();
+
+		// Primary command buffer of the frame, recorded from scratch every frame
+		VkCommandBuffer GetCommandBuffer() const { return CommandBuffer; }
+		VLFrameRingBuffer& GetRing() { return *Ring; }
+		// Descriptor sets are valid until the next Begin(), there is no need to free them
+		VkDescriptorSet AllocateDescriptorSet(VkDescriptorSetLayout Layout);
+
+		// Capacity of the descriptor pool, per frame
+		static constexpr uint32_t MaxDescriptorSets = 256;
+		static constexpr uint32_t MaxDescriptorsPerType = 256;
+
+	private:
+		VLDevice& Device;
+		VkCommandPool CommandPool = VK_NULL_HANDLE;
+		VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+		VkDescriptorPool DescriptorPool = VK_NULL_HANDLE;
+		std::unique_ptr<VLFrameRingBuffer> Ring;
+	};
+}
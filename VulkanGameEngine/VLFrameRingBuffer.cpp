@@ -0,0 +1,68 @@
+#include "VLFrameRingBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLFrameRingBuffer::VLFrameRingBuffer(VLDevice& InDevice, VkDeviceSize InPartitionSize, uint32_t InPartitionCount,
+		VkBufferUsageFlags Usage) :
+		PartitionSize{ InPartitionSize },
+		PartitionCount{ InPartitionCount }
+	{
+		assert(PartitionCount > 0 && "Ring buffer needs at least one partition");
+
+		// Note:	Every allocation must satisfy the strictest offset alignment of the usages the buffer was created for
+		const VkPhysicalDeviceLimits& limits = InDevice.DeviceProperties.limits;
+		MinAlignment = 4;
+		if (Usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+		{
+			MinAlignment = std::max(MinAlignment, limits.minUniformBufferOffsetAlignment);
+		}
+		if (Usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+		{
+			MinAlignment = std::max(MinAlignment, limits.minStorageBufferOffsetAlignment);
+		}
+
+		// Keep every partition start aligned as well
+		PartitionSize = (PartitionSize + MinAlignment - 1) / MinAlignment * MinAlignment;
+
+		// Note:	Written front to back once per frame, which is what write-combined memory is made for
+		Buffer = std::make_unique<VLMappedBuffer>(
+			InDevice,
+			PartitionSize * PartitionCount,
+			Usage,
+			VLHostAccess::SequentialWrite);
+
+		BeginFrame(0);
+	}
+
+	void VLFrameRingBuffer::BeginFrame(size_t FrameIndex)
+	{
+		assert(FrameIndex < PartitionCount && "Frame index out of range of the ring buffer partitions");
+		PartitionBegin = PartitionSize * FrameIndex;
+		Head = PartitionBegin;
+	}
+
+	VLRingAllocation VLFrameRingBuffer::Allocate(VkDeviceSize Size, VkDeviceSize Alignment)
+	{
+		const VkDeviceSize alignment = std::max(Alignment, MinAlignment);
+		const VkDeviceSize offset = (Head + alignment - 1) / alignment * alignment;
+		if (offset + Size > PartitionBegin + PartitionSize)
+		{
+			throw std::runtime_error("frame ring buffer partition is exhausted!");
+		}
+		Head = offset + Size;
+
+		// The caller writes the data before the frame is submitted, which is when dirty ranges get flushed
+		Buffer->MarkDirty(offset, Size);
+
+		VLRingAllocation allocation{};
+		allocation.Buffer = Buffer->GetBuffer();
+		allocation.Offset = offset;
+		allocation.Size = Size;
+		allocation.pData = static_cast<char*>(Buffer->GetMappedData()) + offset;
+		return allocation;
+	}
+}
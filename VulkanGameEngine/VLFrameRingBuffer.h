@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VLDevice.h"
+#include "VLMappedBuffer.h"
+#include "VLStreamingCopy.h"
+
+#include <memory>
+#include <type_traits>
+
+namespace VulkanLearn
+{
+	// A range of transient per-frame memory, valid until the frame it was allocated in has finished on the GPU
+	struct VLRingAllocation
+	{
+		VkBuffer Buffer = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+		void* pData = nullptr;
+	};
+
+	// Persistently mapped buffer split into one partition per frame in flight.
+	// Every frame bump-allocates from its own partition, which is reclaimed as a whole once the GPU is done with it.
+	// Note:	Per-draw data such as uniforms, dynamic vertices or indirect arguments can be written here without
+	//			creating buffers, allocating memory or taking locks.
+	class VLFrameRingBuffer
+	{
+	public:
+		VLFrameRingBuffer(VLDevice& InDevice, VkDeviceSize InPartitionSize, uint32_t InPartitionCount,
+			VkBufferUsageFlags Usage);
+
+		VLFrameRingBuffer(const VLFrameRingBuffer&) = delete;
+		VLFrameRingBuffer(VLFrameRingBuffer&&) = delete;
+		VLFrameRingBuffer& operator=(const VLFrameRingBuffer&) = delete;
+		VLFrameRingBuffer& operator=(VLFrameRingBuffer&&) = delete;
+
+		// Note:	Only call this once the previous frame of FrameIndex has completed,
+		//			all previous allocations of that partition are handed out again afterwards
+		void BeginFrame(size_t FrameIndex);
+
+		VLRingAllocation Allocate(VkDeviceSize Size, VkDeviceSize Alignment = 16);
+
+		template<typename T>
+		VLRingAllocation Push(const T& Data)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Ring buffer data is copied bytewise");
+			VLRingAllocation allocation = Allocate(sizeof(T), alignof(T));
+			VLStreamingCopy(allocation.pData, &Data, sizeof(T));
+			return allocation;
+		}
+
+		// Copies Count consecutive elements, e.g. the per-instance data of a draw
+		template<typename T>
+		VLRingAllocation PushArray(const T* pData, size_t Count)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Ring buffer data is copied bytewise");
+			VLRingAllocation allocation = Allocate(sizeof(T) * Count, alignof(T));
+			VLStreamingCopy(allocation.pData, pData, sizeof(T) * Count);
+			return allocation;
+		}
+
+		VkBuffer GetBuffer() const { return Buffer->GetBuffer(); }
+		VkDeviceSize GetPartitionSize() const { return PartitionSize; }
+		// Bytes handed out in the current partition, useful to size the partitions
+		VkDeviceSize GetUsedBytes() const { return Head - PartitionBegin; }
+
+	private:
+
+		std::unique_ptr<VLMappedBuffer> Buffer;
+
+		VkDeviceSize PartitionSize;
+		uint32_t PartitionCount;
+		VkDeviceSize MinAlignment;
+
+		VkDeviceSize PartitionBegin = 0;
+		VkDeviceSize Head = 0;
+	};
+}
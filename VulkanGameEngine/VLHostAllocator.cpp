@@ -0,0 +1,217 @@
+#include "VLHostAllocator.h"
+
+// std headers
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace VulkanLearn
+{
+	namespace
+	{
+		// Stored right in front of every pointer we hand out, so free and reallocation know what they get
+		struct AllocationHeader
+		{
+			size_t Size;
+			// Distance from the start of the heap block to the returned pointer
+			uint32_t Offset;
+			uint8_t Scope;
+			bool bArena;
+		};
+
+		constexpr size_t MinAlignment = alignof(std::max_align_t) > 16 ? alignof(std::max_align_t) : 16;
+		constexpr size_t HeaderSize = (sizeof(AllocationHeader) + MinAlignment - 1) / MinAlignment * MinAlignment;
+		constexpr size_t ArenaSize = 256 * 1024;
+
+		// One arena per thread, the driver may allocate from its own threads too
+		struct ThreadArena
+		{
+			char* pMemory = nullptr;
+			size_t Head = 0;
+			uint32_t Depth = 0;
+
+			~ThreadArena() { std::free(pMemory); }
+		};
+		thread_local ThreadArena Arena;
+
+		AllocationHeader* GetHeader(void* pMemory)
+		{
+			return reinterpret_cast<AllocationHeader*>(static_cast<char*>(pMemory) - HeaderSize);
+		}
+
+		// Returns a pointer aligned to Alignment with room for the header in front of it
+		char* PlaceAllocation(char* pBlock, size_t Alignment)
+		{
+			const uintptr_t address = reinterpret_cast<uintptr_t>(pBlock) + HeaderSize;
+			return reinterpret_cast<char*>((address + Alignment - 1) / Alignment * Alignment);
+		}
+	}
+
+	VLHostAllocator::ScopedArena::ScopedArena()
+	{
+		if (Arena.pMemory == nullptr)
+		{
+			Arena.pMemory = static_cast<char*>(std::malloc(ArenaSize));
+		}
+		Arena.Depth++;
+	}
+
+	VLHostAllocator::ScopedArena::~ScopedArena()
+	{
+		// Note:	Only the outermost scope drops the arena, nested create calls share it
+		if (--Arena.Depth == 0)
+		{
+			Arena.Head = 0;
+		}
+	}
+
+	VLHostAllocator::VLHostAllocator()
+	{
+		for (CategoryData& category : Categories)
+		{
+			category.Callbacks.pUserData = &category;
+			category.Callbacks.pfnAllocation = &VLHostAllocator::Allocate;
+			category.Callbacks.pfnReallocation = &VLHostAllocator::Reallocate;
+			category.Callbacks.pfnFree = &VLHostAllocator::Free;
+			category.Callbacks.pfnInternalAllocation = &VLHostAllocator::InternalAllocate;
+			category.Callbacks.pfnInternalFree = &VLHostAllocator::InternalFree;
+		}
+	}
+
+	VLHostAllocator::Statistics VLHostAllocator::GetStatistics(VLHostAllocationCategory Category) const
+	{
+		const CategoryData& category = Categories[static_cast<size_t>(Category)];
+
+		Statistics statistics{};
+		statistics.CurrentBytes = category.CurrentBytes;
+		statistics.PeakBytes = category.PeakBytes;
+		statistics.AllocationCount = category.AllocationCount;
+		statistics.InternalBytes = category.InternalBytes;
+		for (size_t scope = 0; scope < ScopeCount; scope++)
+		{
+			statistics.ScopeBytes[scope] = category.ScopeBytes[scope];
+		}
+		return statistics;
+	}
+
+	void VLHostAllocator::LogStatistics() const
+	{
+		static const char* categoryNames[] = { "Instance", "Device", "SwapChain", "Pipeline" };
+		for (size_t i = 0; i < static_cast<size_t>(VLHostAllocationCategory::Count); i++)
+		{
+			const Statistics statistics = GetStatistics(static_cast<VLHostAllocationCategory>(i));
+			std::cout << "Driver host memory [" << categoryNames[i] << "]: "
+				<< statistics.CurrentBytes << " bytes in use, "
+				<< statistics.PeakBytes << " bytes peak, "
+				<< statistics.AllocationCount << " allocations, "
+				<< statistics.InternalBytes << " internal bytes" << std::endl;
+		}
+	}
+
+	void* VKAPI_PTR VLHostAllocator::Allocate(
+		void* pUserData, size_t Size, size_t Alignment, VkSystemAllocationScope Scope)
+	{
+		CategoryData& category = *static_cast<CategoryData*>(pUserData);
+		Alignment = std::max(Alignment, MinAlignment);
+
+		// Note:	Command scope allocations don't outlive the call, take them from the arena when one is active
+		//			and fall back to the heap once it is full
+		char* pBlock = nullptr;
+		char* pMemory = nullptr;
+		bool bArena = false;
+		if (Scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && Arena.Depth > 0 && Arena.pMemory != nullptr)
+		{
+			pMemory = PlaceAllocation(Arena.pMemory + Arena.Head, Alignment);
+			const size_t end = static_cast<size_t>(pMemory - Arena.pMemory) + Size;
+			if (end <= ArenaSize)
+			{
+				pBlock = Arena.pMemory + Arena.Head;
+				Arena.Head = end;
+				bArena = true;
+			}
+		}
+
+		if (!bArena)
+		{
+			pBlock = static_cast<char*>(std::malloc(Size + HeaderSize + Alignment));
+			if (pBlock == nullptr)
+			{
+				return nullptr;
+			}
+			pMemory = PlaceAllocation(pBlock, Alignment);
+
+			// Arena memory is dropped as a whole and never shows up in the usage
+			const size_t current = category.CurrentBytes += Size;
+			size_t peak = category.PeakBytes;
+			while (current > peak && !category.PeakBytes.compare_exchange_weak(peak, current))
+			{
+			}
+			category.ScopeBytes[Scope] += Size;
+		}
+		category.AllocationCount++;
+
+		AllocationHeader* pHeader = GetHeader(pMemory);
+		pHeader->Size = Size;
+		pHeader->Offset = static_cast<uint32_t>(pMemory - pBlock);
+		pHeader->Scope = static_cast<uint8_t>(Scope);
+		pHeader->bArena = bArena;
+		return pMemory;
+	}
+
+	void* VKAPI_PTR VLHostAllocator::Reallocate(
+		void* pUserData, void* pOriginal, size_t Size, size_t Alignment, VkSystemAllocationScope Scope)
+	{
+		if (pOriginal == nullptr)
+		{
+			return Allocate(pUserData, Size, Alignment, Scope);
+		}
+		if (Size == 0)
+		{
+			Free(pUserData, pOriginal);
+			return nullptr;
+		}
+
+		void* pMemory = Allocate(pUserData, Size, Alignment, Scope);
+		if (pMemory == nullptr)
+		{
+			// Note:	The original allocation must stay untouched when reallocation fails
+			return nullptr;
+		}
+		memcpy(pMemory, pOriginal, std::min(Size, GetHeader(pOriginal)->Size));
+		Free(pUserData, pOriginal);
+		return pMemory;
+	}
+
+	void VKAPI_PTR VLHostAllocator::Free(void* pUserData, void* pMemory)
+	{
+		if (pMemory == nullptr)
+		{
+			return;
+		}
+
+		const AllocationHeader* pHeader = GetHeader(pMemory);
+		if (pHeader->bArena)
+		{
+			return;
+		}
+
+		CategoryData& category = *static_cast<CategoryData*>(pUserData);
+		category.CurrentBytes -= pHeader->Size;
+		category.ScopeBytes[pHeader->Scope] -= pHeader->Size;
+		std::free(static_cast<char*>(pMemory) - pHeader->Offset);
+	}
+
+	void VKAPI_PTR VLHostAllocator::InternalAllocate(
+		void* pUserData, size_t Size, VkInternalAllocationType, VkSystemAllocationScope)
+	{
+		static_cast<CategoryData*>(pUserData)->InternalBytes += Size;
+	}
+
+	void VKAPI_PTR VLHostAllocator::InternalFree(
+		void* pUserData, size_t Size, VkInternalAllocationType, VkSystemAllocationScope)
+	{
+		static_cast<CategoryData*>(pUserData)->InternalBytes -= Size;
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <cstddef>
+
+namespace VulkanLearn
+{
+	// Engine side owner of the driver objects, every category gets its own callbacks and counters
+	enum class VLHostAllocationCategory
+	{
+		Instance,
+		Device,
+		SwapChain,
+		Pipeline,
+		Count
+	};
+
+	// VkAllocationCallbacks that route the CPU memory the driver allocates for our objects through the engine,
+	// accounted per category and per VkSystemAllocationScope.
+	// Note:	Objects must be destroyed with callbacks compatible to the ones they were created with,
+	//			so always create and destroy an object with the callbacks of the same category.
+	class VLHostAllocator
+	{
+	public:
+		// Command, object, cache, device and instance
+		static constexpr size_t ScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+		struct Statistics
+		{
+			size_t CurrentBytes;
+			size_t PeakBytes;
+			// Number of allocations and reallocations, a steadily climbing count points at allocation churn
+			size_t AllocationCount;
+			size_t InternalBytes;
+			size_t ScopeBytes[ScopeCount];
+		};
+
+		// Linear arena for the VK_SYSTEM_ALLOCATION_SCOPE_COMMAND allocations of the create calls in its lifetime.
+		// Those only live for the duration of the command, so they are bump allocated on the calling thread and
+		// dropped as a whole, instead of hitting the heap for every temporary the driver needs.
+		class ScopedArena
+		{
+		public:
+			ScopedArena();
+			~ScopedArena();
+
+			ScopedArena(const ScopedArena&) = delete;
+			ScopedArena(ScopedArena&&) = delete;
+			ScopedArena& operator=(const ScopedArena&) = delete;
+			ScopedArena& operator=(ScopedArena&&) = delete;
+		};
+
+		VLHostAllocator();
+
+		VLHostAllocator(const VLHostAllocator&) = delete;
+		VLHostAllocator(VLHostAllocator&&) = delete;
+		VLHostAllocator& operator=(const VLHostAllocator&) = delete;
+		VLHostAllocator& operator=(VLHostAllocator&&) = delete;
+
+		const VkAllocationCallbacks* GetCallbacks(VLHostAllocationCategory Category) const
+		{
+			return &Categories[static_cast<size_t>(Category)].Callbacks;
+		}
+		Statistics GetStatistics(VLHostAllocationCategory Category) const;
+		void LogStatistics() const;
+
+	private:
+		struct CategoryData
+		{
+			VkAllocationCallbacks Callbacks;
+			std::atomic<size_t> CurrentBytes{ 0 };
+			std::atomic<size_t> PeakBytes{ 0 };
+			std::atomic<size_t> AllocationCount{ 0 };
+			std::atomic<size_t> InternalBytes{ 0 };
+			std::atomic<size_t> ScopeBytes[ScopeCount] = {};
+		};
+
+		static void* VKAPI_PTR Allocate(
+			void* pUserData, size_t Size, size_t Alignment, VkSystemAllocationScope Scope);
+		static void* VKAPI_PTR Reallocate(
+			void* pUserData, void* pOriginal, size_t Size, size_t Alignment, VkSystemAllocationScope Scope);
+		static void VKAPI_PTR Free(void* pUserData, void* pMemory);
+		static void VKAPI_PTR InternalAllocate(
+			void* pUserData, size_t Size, VkInternalAllocationType Type, VkSystemAllocationScope Scope);
+		static void VKAPI_PTR InternalFree(
+			void* pUserData, size_t Size, VkInternalAllocationType Type, VkSystemAllocationScope Scope);
+
+		CategoryData Categories[static_cast<size_t>(VLHostAllocationCategory::Count)];
+	};
+}
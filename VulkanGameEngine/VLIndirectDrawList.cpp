@@ -0,0 +1,121 @@
+#include "VLIndirectDrawList.h"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLIndirectDrawList::VLIndirectDrawList(VLDevice& InDevice, uint32_t InMaxDraws) :
+		Device{ InDevice },
+		MaxDraws{ InMaxDraws }
+	{
+		IndexedDrawsOffset = DrawsOffset + VkDeviceSize(MaxDraws) * sizeof(VkDrawIndirectCommand);
+		const VkDeviceSize size = IndexedDrawsOffset + VkDeviceSize(MaxDraws) * sizeof(VkDrawIndexedIndirectCommand);
+
+		// VK_BUFFER_USAGE_STORAGE_BUFFER_BIT:	Lets a culling pass rewrite the commands and counts on the GPU
+		Buffer = std::make_unique<VLMappedBuffer>(
+			Device,
+			size,
+			VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VLHostAccess::SequentialWrite);
+		Upload();
+	}
+
+	void VLIndirectDrawList::Clear()
+	{
+		Draws.clear();
+		IndexedDraws.clear();
+	}
+
+	void VLIndirectDrawList::Add(const VLModel& Model, uint32_t InstanceCount, uint32_t FirstInstance)
+	{
+		assert((FirstInstance == 0 || Device.IsDrawIndirectFirstInstanceSupported()) &&
+			"drawIndirectFirstInstance is not supported by the device");
+		if (Model.IsIndexed())
+		{
+			if (IndexedDraws.size() >= MaxDraws)
+			{
+				throw std::runtime_error("indirect draw list is out of indexed draws!");
+			}
+			IndexedDraws.push_back(Model.GetDrawIndexedIndirectCommand(InstanceCount, FirstInstance));
+		}
+		else
+		{
+			if (Draws.size() >= MaxDraws)
+			{
+				throw std::runtime_error("indirect draw list is out of draws!");
+			}
+			Draws.push_back(Model.GetDrawIndirectCommand(InstanceCount, FirstInstance));
+		}
+	}
+
+	void VLIndirectDrawList::Upload()
+	{
+		UploadedDrawCount = static_cast<uint32_t>(Draws.size());
+		UploadedIndexedDrawCount = static_cast<uint32_t>(IndexedDraws.size());
+
+		const uint32_t counts[] = { UploadedDrawCount, UploadedIndexedDrawCount };
+		Buffer->Write(counts, sizeof(counts), DrawCountOffset);
+		if (!Draws.empty())
+		{
+			Buffer->Write(Draws.data(), Draws.size() * sizeof(VkDrawIndirectCommand), DrawsOffset);
+		}
+		if (!IndexedDraws.empty())
+		{
+			Buffer->Write(IndexedDraws.data(), IndexedDraws.size() * sizeof(VkDrawIndexedIndirectCommand),
+				IndexedDrawsOffset);
+		}
+	}
+
+	void VLIndirectDrawList::Record(VkCommandBuffer CommandBuffer)
+	{
+		RecordDraws(CommandBuffer, false, DrawsOffset, DrawCountOffset, UploadedDrawCount,
+			sizeof(VkDrawIndirectCommand));
+		RecordDraws(CommandBuffer, true, IndexedDrawsOffset, IndexedDrawCountOffset, UploadedIndexedDrawCount,
+			sizeof(VkDrawIndexedIndirectCommand));
+	}
+
+	void VLIndirectDrawList::RecordDraws(VkCommandBuffer CommandBuffer, bool bIndexed, VkDeviceSize Offset,
+		VkDeviceSize CountOffset, uint32_t DrawCount, uint32_t Stride)
+	{
+		const VkBuffer buffer = Buffer->GetBuffer();
+		if (Device.IsDrawIndirectCountSupported())
+		{
+			// Note:	MaxDraws rather than the current count, so uploads up to the capacity need no re-recording.
+			//			Recorded even while the array is empty, later uploads fill it in
+			if (bIndexed)
+			{
+				Device.CmdDrawIndexedIndirectCount(CommandBuffer, buffer, Offset, buffer, CountOffset, MaxDraws, Stride);
+			}
+			else
+			{
+				Device.CmdDrawIndirectCount(CommandBuffer, buffer, Offset, buffer, CountOffset, MaxDraws, Stride);
+			}
+			return;
+		}
+
+		if (DrawCount == 0)
+		{
+			return;
+		}
+
+		// Note:	Without multiDrawIndirect the draw count of an indirect call has to be 1
+		const uint32_t maxDrawsPerCall = Device.IsMultiDrawIndirectSupported() ?
+			std::max(1u, Device.DeviceProperties.limits.maxDrawIndirectCount) : 1;
+		for (uint32_t firstDraw = 0; firstDraw < DrawCount; firstDraw += maxDrawsPerCall)
+		{
+			const uint32_t callDrawCount = std::min(maxDrawsPerCall, DrawCount - firstDraw);
+			const VkDeviceSize callOffset = Offset + VkDeviceSize(firstDraw) * Stride;
+			if (bIndexed)
+			{
+				vkCmdDrawIndexedIndirect(CommandBuffer, buffer, callOffset, callDrawCount, Stride);
+			}
+			else
+			{
+				vkCmdDrawIndirect(CommandBuffer, buffer, callOffset, callDrawCount, Stride);
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "VLDevice.h"
+#include "VLMappedBuffer.h"
+#include "VLModel.h"
+
+#include <memory>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Draw commands of many models in a GPU buffer, recorded with a handful of vkCmdDraw*Indirect calls instead of
+	// one vkCmdDraw per model.
+	// With VK_KHR_draw_indirect_count the number of draws is read from the buffer too, so a recording stays valid
+	// when the list grows or shrinks, and a compute pass can later cull by rewriting the commands and counts.
+	// Without it, multiDrawIndirect batches the draws and, failing that, every command gets an indirect call.
+	// Note:	All models in a list must share their geometry (e.g. one VLMeshPool), which is bound by the caller.
+	//			Frames that execute a recording read the buffer, so only Upload() once those frames have completed.
+	//			Content that changes every frame needs one list per frame in flight.
+	class VLIndirectDrawList
+	{
+	public:
+		VLIndirectDrawList(VLDevice& InDevice, uint32_t InMaxDraws);
+
+		VLIndirectDrawList(const VLIndirectDrawList&) = delete;
+		VLIndirectDrawList(VLIndirectDrawList&&) = delete;
+		VLIndirectDrawList& operator=(const VLIndirectDrawList&) = delete;
+		VLIndirectDrawList& operator=(VLIndirectDrawList&&) = delete;
+
+		void Clear();
+		// Indexed and non-indexed models go to separate command arrays, each holds up to MaxDraws commands
+		// Note:	The offsets of pooled models are captured here, add them again after the pool was defragmented
+		void Add(const VLModel& Model, uint32_t InstanceCount = 1, uint32_t FirstInstance = 0);
+		// Writes the commands and counts to the buffer, they are flushed together with the frame
+		void Upload();
+		// Records the draws as uploaded last. Without draw count support the counts are baked into the recording,
+		// re-record after an upload that changed them, an array that was empty at record time is never drawn.
+		// Note:	With draw count support both arrays are always recorded, so an index buffer has to be bound
+		//			even when only non-indexed models were added.
+		void Record(VkCommandBuffer CommandBuffer);
+
+		// True when the counts are read from the buffer at execution time
+		bool IsCountFromBuffer() const { return Device.IsDrawIndirectCountSupported(); }
+		uint32_t GetDrawCount() const { return static_cast<uint32_t>(Draws.size() + IndexedDraws.size()); }
+		VkBuffer GetBuffer() const { return Buffer->GetBuffer(); }
+
+	private:
+		void RecordDraws(VkCommandBuffer CommandBuffer, bool bIndexed, VkDeviceSize Offset, VkDeviceSize CountOffset,
+			uint32_t DrawCount, uint32_t Stride);
+
+		VLDevice& Device;
+		uint32_t MaxDraws;
+		// Layout: draw count, indexed draw count, padding, MaxDraws VkDrawIndirectCommands,
+		//			MaxDraws VkDrawIndexedIndirectCommands
+		std::unique_ptr<VLMappedBuffer> Buffer;
+		VkDeviceSize IndexedDrawsOffset;
+
+		std::vector<VkDrawIndirectCommand> Draws;
+		std::vector<VkDrawIndexedIndirectCommand> IndexedDraws;
+		uint32_t UploadedDrawCount = 0;
+		uint32_t UploadedIndexedDrawCount = 0;
+
+		static constexpr VkDeviceSize DrawCountOffset = 0;
+		static constexpr VkDeviceSize IndexedDrawCountOffset = sizeof(uint32_t);
+		static constexpr VkDeviceSize DrawsOffset = 16;
+	};
+}
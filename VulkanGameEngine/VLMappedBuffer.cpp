@@ -0,0 +1,76 @@
+#include "VLMappedBuffer.h"
+#include "VLStreamingCopy.h"
+
+#include <cassert>
+#include <cstring>
+
+namespace VulkanLearn
+{
+	VLMappedBuffer::VLMappedBuffer(VLDevice& InDevice, VkDeviceSize InSize, VkBufferUsageFlags Usage,
+		VLHostAccess InAccess) :
+		Device{ InDevice },
+		Size{ InSize },
+		Access{ InAccess }
+	{
+		// Note:	Only HOST_VISIBLE is required, the preference decides between write-combined and cached types.
+		//			Devices without a cached type (or without a coherent one) fall back to whatever is host visible.
+		const VkMemoryPropertyFlags preferred = Access == VLHostAccess::Random ?
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT :
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		Device.CreateBuffer(
+			Size,
+			Usage,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			Buffer,
+			BufferAllocation,
+			preferred);
+
+		bCoherent = Device.IsHostCoherent(BufferAllocation);
+	}
+
+	VLMappedBuffer::~VLMappedBuffer()
+	{
+		Device.DeferDestroyBuffer(Buffer, BufferAllocation);
+	}
+
+	void VLMappedBuffer::Write(const void* Data, VkDeviceSize DataSize, VkDeviceSize Offset)
+	{
+		assert(Offset + DataSize <= Size && "Write out of range of the mapped buffer");
+		char* pDst = static_cast<char*>(BufferAllocation.pMapped) + Offset;
+		// Note:	Cached memory is meant to be read by the host again, keep the data in the cache for that
+		if (Access == VLHostAccess::SequentialWrite)
+		{
+			VLStreamingCopy(pDst, Data, static_cast<size_t>(DataSize));
+		}
+		else
+		{
+			memcpy(pDst, Data, static_cast<size_t>(DataSize));
+		}
+		MarkDirty(Offset, DataSize);
+	}
+
+	void VLMappedBuffer::MarkDirty(VkDeviceSize Offset, VkDeviceSize DirtySize)
+	{
+		if (!bCoherent)
+		{
+			Device.QueueMappedMemoryFlush(BufferAllocation, Offset, DirtySize);
+		}
+	}
+
+	void VLMappedBuffer::Flush(VkDeviceSize Offset, VkDeviceSize FlushSize)
+	{
+		if (!bCoherent)
+		{
+			Device.QueueMappedMemoryFlush(BufferAllocation, Offset, FlushSize);
+			Device.FlushMappedMemory();
+		}
+	}
+
+	void VLMappedBuffer::Invalidate(VkDeviceSize Offset, VkDeviceSize InvalidateSize)
+	{
+		if (!bCoherent)
+		{
+			Device.InvalidateMappedMemory(BufferAllocation, Offset, InvalidateSize);
+		}
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "VLDevice.h"
+
+namespace VulkanLearn
+{
+	// How the host is going to touch the memory, decides which memory type the buffer prefers
+	enum class VLHostAccess
+	{
+		// Written front to back and never read back (uniforms, dynamic vertices, ...): coherent, write-combined memory
+		SequentialWrite,
+		// Partially updated or read back by the host: cached memory, which is often not coherent
+		Random
+	};
+
+	// Host visible buffer that stays mapped for its whole lifetime.
+	// Writes are tracked as dirty ranges and flushed together with all other dirty ranges of the frame,
+	// so the buffer can live in non-coherent (e.g. HOST_CACHED) memory without the caller noticing.
+	// Note:	Reads and writes to uncached memory go straight over the bus, so avoid reading back from a
+	//			SequentialWrite buffer and avoid scattered small writes into it.
+	class VLMappedBuffer
+	{
+	public:
+		VLMappedBuffer(VLDevice& InDevice, VkDeviceSize InSize, VkBufferUsageFlags Usage, VLHostAccess InAccess);
+		~VLMappedBuffer();
+
+		VLMappedBuffer(const VLMappedBuffer&) = delete;
+		VLMappedBuffer(VLMappedBuffer&&) = delete;
+		VLMappedBuffer& operator=(const VLMappedBuffer&) = delete;
+		VLMappedBuffer& operator=(VLMappedBuffer&&) = delete;
+
+		// Copies Data into the buffer and marks the range dirty
+		void Write(const void* Data, VkDeviceSize DataSize, VkDeviceSize Offset = 0);
+		// For writes done through GetMappedData directly
+		void MarkDirty(VkDeviceSize Offset, VkDeviceSize DirtySize);
+		// Flushes right away instead of with the frame, e.g. before a submit outside of the swap chain
+		void Flush(VkDeviceSize Offset = 0, VkDeviceSize FlushSize = VK_WHOLE_SIZE);
+		// Call before reading data the GPU wrote, once the work that wrote it has completed
+		void Invalidate(VkDeviceSize Offset = 0, VkDeviceSize InvalidateSize = VK_WHOLE_SIZE);
+
+		void* GetMappedData() const { return BufferAllocation.pMapped; }
+		VkBuffer GetBuffer() const { return Buffer; }
+		VkDeviceSize GetSize() const { return Size; }
+		bool IsCoherent() const { return bCoherent; }
+
+	private:
+
+		VLDevice& Device;
+		VkBuffer Buffer;
+		VLAllocation BufferAllocation;
+		VkDeviceSize Size;
+		VLHostAccess Access;
+		bool bCoherent;
+	};
+}
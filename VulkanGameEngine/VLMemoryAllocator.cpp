@@ -0,0 +1,308 @@
+#include "VLMemoryAllocator.h"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	struct VLMemoryBlock
+	{
+		struct FreeRange
+		{
+			VkDeviceSize Offset;
+			VkDeviceSize Size;
+		};
+
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkDeviceSize Size = 0;
+		void* pMapped = nullptr;
+		uint32_t MemoryTypeIndex = 0;
+		uint32_t PoolIndex = 0;
+		uint32_t AllocationCount = 0;
+		// Dedicated blocks hold exactly one oversized resource and are released as soon as it is freed
+		bool bDedicated = false;
+		// Sorted on offset so neighbouring ranges can be merged on free
+		std::vector<FreeRange> FreeRanges;
+	};
+
+	static VkDeviceSize AlignUp(VkDeviceSize Value, VkDeviceSize Alignment)
+	{
+		return (Value + Alignment - 1) / Alignment * Alignment;
+	}
+
+	VLMemoryAllocator::VLMemoryAllocator(VkDevice InDevice, const VkPhysicalDeviceMemoryProperties& InMemoryProperties,
+		VkDeviceSize InBufferImageGranularity, VkDeviceSize InNonCoherentAtomSize,
+		const VkAllocationCallbacks* pInAllocationCallbacks) :
+		Device{ InDevice },
+		pAllocationCallbacks{ pInAllocationCallbacks },
+		MemoryProperties{ InMemoryProperties },
+		BufferImageGranularity{ InBufferImageGranularity },
+		NonCoherentAtomSize{ InNonCoherentAtomSize }
+	{
+		Pools.resize(MemoryProperties.memoryTypeCount * 2);
+	}
+
+	VLMemoryAllocator::~VLMemoryAllocator()
+	{
+		for (MemoryPool& pool : Pools)
+		{
+			for (auto& pBlock : pool.Blocks)
+			{
+				assert(pBlock->AllocationCount == 0 && "Memory block destroyed while still in use");
+				vkFreeMemory(Device, pBlock->Memory, pAllocationCallbacks);
+			}
+			pool.Blocks.clear();
+		}
+	}
+
+	VLAllocation VLMemoryAllocator::Allocate(
+		const VkMemoryRequirements& Requirements, uint32_t MemoryTypeIndex, bool bLinearResource)
+	{
+		VLAllocation allocation{};
+		if (!TryAllocate(Requirements, MemoryTypeIndex, bLinearResource, allocation))
+		{
+			throw std::runtime_error("failed to allocate device memory block!");
+		}
+		return allocation;
+	}
+
+	bool VLMemoryAllocator::TryAllocate(const VkMemoryRequirements& InRequirements, uint32_t MemoryTypeIndex,
+		bool bLinearResource, VLAllocation& OutAllocation)
+	{
+		// Note:	Flushes and invalidates of non-coherent memory work on whole atoms. Aligning both ends of the
+		//			allocation to nonCoherentAtomSize lets the owner round its ranges outwards without touching
+		//			the memory of a neighbour.
+		VkMemoryRequirements Requirements = InRequirements;
+		const VkMemoryPropertyFlags typeFlags = MemoryProperties.memoryTypes[MemoryTypeIndex].propertyFlags;
+		if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+		{
+			Requirements.alignment = std::max(Requirements.alignment, NonCoherentAtomSize);
+			Requirements.size = AlignUp(Requirements.size, NonCoherentAtomSize);
+		}
+
+		const uint32_t poolIndex = GetPoolIndex(MemoryTypeIndex, bLinearResource);
+		MemoryPool& pool = Pools[poolIndex];
+		const VkDeviceSize preferredBlockSize = GetPreferredBlockSize(MemoryTypeIndex);
+
+		VLMemoryBlock* pTargetBlock = nullptr;
+		VkDeviceSize offset = 0;
+
+		// Note:	Resources larger than half a block would waste most of it, give them their own memory instead
+		if (Requirements.size > preferredBlockSize / 2)
+		{
+			pTargetBlock = CreateBlock(poolIndex, MemoryTypeIndex, Requirements.size, true);
+			if (pTargetBlock == nullptr)
+			{
+				return false;
+			}
+			pTargetBlock->FreeRanges.clear();
+		}
+		else
+		{
+			for (auto& pBlock : pool.Blocks)
+			{
+				if (!pBlock->bDedicated &&
+					TryAllocateFromBlock(*pBlock, Requirements.size, Requirements.alignment, offset))
+				{
+					pTargetBlock = pBlock.get();
+					break;
+				}
+			}
+
+			if (pTargetBlock == nullptr)
+			{
+				pTargetBlock = CreateBlock(poolIndex, MemoryTypeIndex, preferredBlockSize, false);
+				if (pTargetBlock == nullptr)
+				{
+					return false;
+				}
+				bool bSucceeded = TryAllocateFromBlock(*pTargetBlock, Requirements.size, Requirements.alignment, offset);
+				assert(bSucceeded && "A fresh memory block must fit any non-dedicated allocation");
+				(void)bSucceeded;
+			}
+		}
+
+		pTargetBlock->AllocationCount++;
+		AllocatedBytes += Requirements.size;
+		HeapAllocatedBytes[MemoryProperties.memoryTypes[MemoryTypeIndex].heapIndex] += Requirements.size;
+
+		OutAllocation = VLAllocation{};
+		OutAllocation.Memory = pTargetBlock->Memory;
+		OutAllocation.Offset = offset;
+		OutAllocation.Size = Requirements.size;
+		OutAllocation.MemoryTypeIndex = MemoryTypeIndex;
+		OutAllocation.pBlock = pTargetBlock;
+		if (pTargetBlock->pMapped != nullptr)
+		{
+			OutAllocation.pMapped = static_cast<char*>(pTargetBlock->pMapped) + offset;
+		}
+		return true;
+	}
+
+	void VLMemoryAllocator::Free(VLAllocation& Allocation)
+	{
+		VLMemoryBlock* pBlock = Allocation.pBlock;
+		if (pBlock == nullptr)
+		{
+			return;
+		}
+
+		AllocatedBytes -= Allocation.Size;
+		HeapAllocatedBytes[MemoryProperties.memoryTypes[Allocation.MemoryTypeIndex].heapIndex] -= Allocation.Size;
+		pBlock->AllocationCount--;
+
+		if (pBlock->bDedicated)
+		{
+			DestroyBlock(pBlock);
+		}
+		else
+		{
+			// Insert the range back in offset order and merge it with its neighbours
+			auto& ranges = pBlock->FreeRanges;
+			auto it = std::lower_bound(ranges.begin(), ranges.end(), Allocation.Offset,
+				[](const VLMemoryBlock::FreeRange& Range, VkDeviceSize Offset) { return Range.Offset < Offset; });
+			it = ranges.insert(it, { Allocation.Offset, Allocation.Size });
+
+			auto next = it + 1;
+			if (next != ranges.end() && it->Offset + it->Size == next->Offset)
+			{
+				it->Size += next->Size;
+				ranges.erase(next);
+			}
+			if (it != ranges.begin())
+			{
+				auto previous = it - 1;
+				if (previous->Offset + previous->Size == it->Offset)
+				{
+					previous->Size += it->Size;
+					ranges.erase(it);
+				}
+			}
+
+			// Keep the first block of a pool around to avoid allocation churn, release any other empty block
+			if (pBlock->AllocationCount == 0 && Pools[pBlock->PoolIndex].Blocks.front().get() != pBlock)
+			{
+				DestroyBlock(pBlock);
+			}
+		}
+
+		Allocation = VLAllocation{};
+	}
+
+	uint32_t VLMemoryAllocator::GetBlockCount() const
+	{
+		size_t count = 0;
+		for (const MemoryPool& pool : Pools)
+		{
+			count += pool.Blocks.size();
+		}
+		return static_cast<uint32_t>(count);
+	}
+
+	VLMemoryBlock* VLMemoryAllocator::CreateBlock(
+		uint32_t PoolIndex, uint32_t MemoryTypeIndex, VkDeviceSize Size, bool bDedicated)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = Size;
+		allocInfo.memoryTypeIndex = MemoryTypeIndex;
+
+		auto pBlock = std::make_unique<VLMemoryBlock>();
+		const VkResult result = vkAllocateMemory(Device, &allocInfo, pAllocationCallbacks, &pBlock->Memory);
+		if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY)
+		{
+			return nullptr;
+		}
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory block!");
+		}
+
+		pBlock->Size = Size;
+		pBlock->MemoryTypeIndex = MemoryTypeIndex;
+		pBlock->PoolIndex = PoolIndex;
+		pBlock->bDedicated = bDedicated;
+		pBlock->FreeRanges.push_back({ 0, Size });
+
+		// Note:	A memory object can only be mapped once, so host visible blocks are mapped for their whole lifetime
+		//			and every allocation simply points into that mapping
+		if (MemoryProperties.memoryTypes[MemoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (vkMapMemory(Device, pBlock->Memory, 0, VK_WHOLE_SIZE, 0, &pBlock->pMapped) != VK_SUCCESS)
+			{
+				vkFreeMemory(Device, pBlock->Memory, pAllocationCallbacks);
+				throw std::runtime_error("failed to map device memory block!");
+			}
+		}
+
+		HeapBlockBytes[MemoryProperties.memoryTypes[MemoryTypeIndex].heapIndex] += Size;
+		Pools[PoolIndex].Blocks.push_back(std::move(pBlock));
+		return Pools[PoolIndex].Blocks.back().get();
+	}
+
+	void VLMemoryAllocator::DestroyBlock(VLMemoryBlock* pBlock)
+	{
+		auto& blocks = Pools[pBlock->PoolIndex].Blocks;
+		auto it = std::find_if(blocks.begin(), blocks.end(),
+			[pBlock](const auto& pOther) { return pOther.get() == pBlock; });
+		assert(it != blocks.end() && "Memory block does not belong to its pool");
+
+		// Note:	Freeing memory implicitly unmaps it
+		vkFreeMemory(Device, pBlock->Memory, pAllocationCallbacks);
+		HeapBlockBytes[MemoryProperties.memoryTypes[pBlock->MemoryTypeIndex].heapIndex] -= pBlock->Size;
+		blocks.erase(it);
+	}
+
+	uint32_t VLMemoryAllocator::GetPoolIndex(uint32_t MemoryTypeIndex, bool bLinearResource) const
+	{
+		// Note:	Linear and optimal resources that share a bufferImageGranularity "page" alias on some hardware.
+		//			Keeping them in separate blocks honours the granularity without padding every allocation.
+		const bool bSeparateOptimal = BufferImageGranularity > 1 && !bLinearResource;
+		return MemoryTypeIndex * 2 + (bSeparateOptimal ? 1 : 0);
+	}
+
+	VkDeviceSize VLMemoryAllocator::GetPreferredBlockSize(uint32_t MemoryTypeIndex) const
+	{
+		// Small heaps (e.g. the 256MB host visible device local heap) get proportionally smaller blocks
+		const uint32_t heapIndex = MemoryProperties.memoryTypes[MemoryTypeIndex].heapIndex;
+		const VkDeviceSize heapSize = MemoryProperties.memoryHeaps[heapIndex].size;
+		return std::min(DefaultBlockSize, AlignUp(heapSize / 8, 1024 * 1024));
+	}
+
+	bool VLMemoryAllocator::TryAllocateFromBlock(
+		VLMemoryBlock& Block, VkDeviceSize Size, VkDeviceSize Alignment, VkDeviceSize& OutOffset)
+	{
+		// First fit: good enough for long lived resources, and keeps the free list short through merging
+		for (auto it = Block.FreeRanges.begin(); it != Block.FreeRanges.end(); ++it)
+		{
+			const VkDeviceSize alignedOffset = AlignUp(it->Offset, Alignment);
+			const VkDeviceSize padding = alignedOffset - it->Offset;
+			if (padding + Size > it->Size)
+			{
+				continue;
+			}
+
+			const VkDeviceSize remaining = it->Size - padding - Size;
+			const VkDeviceSize rangeOffset = it->Offset;
+			Block.FreeRanges.erase(it);
+
+			// Note:	Give the alignment padding and the tail back to the free list
+			auto insertIt = std::lower_bound(Block.FreeRanges.begin(), Block.FreeRanges.end(), rangeOffset,
+				[](const VLMemoryBlock::FreeRange& Range, VkDeviceSize Offset) { return Range.Offset < Offset; });
+			if (remaining > 0)
+			{
+				insertIt = Block.FreeRanges.insert(insertIt, { alignedOffset + Size, remaining });
+			}
+			if (padding > 0)
+			{
+				Block.FreeRanges.insert(insertIt, { rangeOffset, padding });
+			}
+
+			OutOffset = alignedOffset;
+			return true;
+		}
+		return false;
+	}
+}
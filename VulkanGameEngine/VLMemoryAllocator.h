@@ -0,0 +1,88 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <memory>
+#include <vector>
+
+namespace VulkanLearn
+{
+	struct VLMemoryBlock;
+
+	// A sub-range of a larger VkDeviceMemory block handed out by the VLMemoryAllocator
+	// Note:	Resources must be bound with Offset, never with 0, as the memory object is shared
+	struct VLAllocation
+	{
+		VkDeviceMemory Memory = VK_NULL_HANDLE;
+		VkDeviceSize Offset = 0;
+		VkDeviceSize Size = 0;
+		// Points to the start of this allocation when the block lives in host visible memory, nullptr otherwise
+		void* pMapped = nullptr;
+		uint32_t MemoryTypeIndex = 0;
+		// Opaque handle to the block the allocation was carved out of
+		VLMemoryBlock* pBlock = nullptr;
+	};
+
+	// Reserves large VkDeviceMemory blocks per memory type and hands out aligned sub-ranges of them.
+	// Note:	Every vkAllocateMemory call is slow and counts towards maxMemoryAllocationCount (which can be as low
+	//			as 4096), so individual buffers and images should never allocate memory on their own.
+	class VLMemoryAllocator
+	{
+	public:
+		// pInAllocationCallbacks:	host allocator for the VkDeviceMemory objects, may be nullptr
+		VLMemoryAllocator(VkDevice InDevice, const VkPhysicalDeviceMemoryProperties& InMemoryProperties,
+			VkDeviceSize InBufferImageGranularity, VkDeviceSize InNonCoherentAtomSize,
+			const VkAllocationCallbacks* pInAllocationCallbacks);
+		~VLMemoryAllocator();
+
+		VLMemoryAllocator(const VLMemoryAllocator&) = delete;
+		VLMemoryAllocator(VLMemoryAllocator&&) = delete;
+		VLMemoryAllocator& operator=(const VLMemoryAllocator&) = delete;
+		VLMemoryAllocator& operator=(VLMemoryAllocator&&) = delete;
+
+		// bLinearResource:	true for buffers and linear images, false for optimally tiled images
+		//					Both kinds are kept in separate blocks when bufferImageGranularity requires it
+		VLAllocation Allocate(const VkMemoryRequirements& Requirements, uint32_t MemoryTypeIndex, bool bLinearResource);
+		// Same as Allocate, but returns false instead of throwing when the heap is out of memory
+		bool TryAllocate(const VkMemoryRequirements& Requirements, uint32_t MemoryTypeIndex, bool bLinearResource,
+			VLAllocation& OutAllocation);
+		void Free(VLAllocation& Allocation);
+
+		uint32_t GetBlockCount() const;
+		VkDeviceSize GetAllocatedBytes() const { return AllocatedBytes; }
+		// Size of all VkDeviceMemory blocks we hold in the given heap
+		VkDeviceSize GetHeapBlockBytes(uint32_t HeapIndex) const { return HeapBlockBytes[HeapIndex]; }
+		// Bytes handed out to resources in the given heap, the rest of its blocks can still be sub-allocated
+		VkDeviceSize GetHeapAllocatedBytes(uint32_t HeapIndex) const { return HeapAllocatedBytes[HeapIndex]; }
+
+	private:
+		struct MemoryPool
+		{
+			std::vector<std::unique_ptr<VLMemoryBlock>> Blocks;
+		};
+
+		// Returns nullptr when the heap has no room left for the block
+		VLMemoryBlock* CreateBlock(uint32_t PoolIndex, uint32_t MemoryTypeIndex, VkDeviceSize Size, bool bDedicated);
+		void DestroyBlock(VLMemoryBlock* pBlock);
+		uint32_t GetPoolIndex(uint32_t MemoryTypeIndex, bool bLinearResource) const;
+		VkDeviceSize GetPreferredBlockSize(uint32_t MemoryTypeIndex) const;
+
+		static bool TryAllocateFromBlock(
+			VLMemoryBlock& Block, VkDeviceSize Size, VkDeviceSize Alignment, VkDeviceSize& OutOffset);
+
+		VkDevice Device;
+		const VkAllocationCallbacks* pAllocationCallbacks;
+		VkPhysicalDeviceMemoryProperties MemoryProperties;
+		VkDeviceSize BufferImageGranularity;
+		VkDeviceSize NonCoherentAtomSize;
+
+		// Indexed by [MemoryTypeIndex * 2 + (optimal image ? 1 : 0)]
+		std::vector<MemoryPool> Pools;
+		VkDeviceSize AllocatedBytes = 0;
+		VkDeviceSize HeapBlockBytes[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize HeapAllocatedBytes[VK_MAX_MEMORY_HEAPS] = {};
+
+		static constexpr VkDeviceSize DefaultBlockSize = 64ull * 1024 * 1024;
+	};
+}
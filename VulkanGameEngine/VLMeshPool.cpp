@@ -0,0 +1,92 @@
+#include "VLMeshPool.h"
+
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLMeshPool::VLMeshPool(VLDevice& InDevice, VkDeviceSize MaxVertices, VkDeviceSize VertexStride,
+		VkDeviceSize MaxIndices) :
+		Device{ InDevice }
+	{
+		VertexPool = std::make_unique<VLTlsfBufferPool>(
+			Device, MaxVertices, VertexStride, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		if (MaxIndices > 0)
+		{
+			IndexPool = std::make_unique<VLTlsfBufferPool>(
+				Device, MaxIndices, sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+		}
+	}
+
+	VLMeshPool::Handle VLMeshPool::AllocateVertices(const void* Vertices, uint32_t VertexCount,
+		VLUploadTicket& OutTicket)
+	{
+		Handle vertices = VertexPool->Allocate(VertexCount);
+		if (vertices == InvalidHandle)
+		{
+			throw std::runtime_error("mesh pool is out of vertex space!");
+		}
+
+		OutTicket = Device.GetUploadEngine().UploadToBuffer(
+			Vertices,
+			VertexCount * VertexPool->GetUnitSize(),
+			VertexPool->GetBuffer(),
+			VertexPool->GetByteOffset(vertices),
+			true);
+		return vertices;
+	}
+
+	VLMeshPool::Handle VLMeshPool::AllocateIndices(const uint32_t* Indices, uint32_t IndexCount,
+		VLUploadTicket& OutTicket)
+	{
+		Handle indices = IndexPool ? IndexPool->Allocate(IndexCount) : InvalidHandle;
+		if (indices == InvalidHandle)
+		{
+			throw std::runtime_error("mesh pool is out of index space!");
+		}
+
+		OutTicket = Device.GetUploadEngine().UploadToBuffer(
+			Indices,
+			IndexCount * sizeof(uint32_t),
+			IndexPool->GetBuffer(),
+			IndexPool->GetByteOffset(indices),
+			true);
+		return indices;
+	}
+
+	bool VLMeshPool::Defragment(VkCommandBuffer CommandBuffer, VkDeviceSize MaxBytes)
+	{
+		const VkDeviceSize movedBytes = VertexPool->Defragment(CommandBuffer, MaxBytes);
+		VkDeviceSize movedIndexBytes = 0;
+		if (IndexPool && movedBytes < MaxBytes)
+		{
+			movedIndexBytes = IndexPool->Defragment(CommandBuffer, MaxBytes - movedBytes);
+		}
+		return movedBytes + movedIndexBytes > 0;
+	}
+
+	void VLMeshPool::Bind(VkCommandBuffer CommandBuffer)
+	{
+		VLCommandRecorder recorder{ CommandBuffer };
+		Bind(recorder);
+	}
+
+	void VLMeshPool::Bind(VLCommandRecorder& Recorder)
+	{
+		VkBuffer buffers[] = { VertexPool->GetBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		Recorder.BindVertexBuffers(0, 1, buffers, offsets);
+		if (IndexPool)
+		{
+			Recorder.BindIndexBuffer(IndexPool->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		}
+	}
+
+	void VLMeshPool::Bind(VLCommandStream& Stream)
+	{
+		Stream.BindVertexBuffer(0, VertexPool->GetBuffer());
+		if (IndexPool)
+		{
+			Stream.BindIndexBuffer(IndexPool->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		}
+	}
+}
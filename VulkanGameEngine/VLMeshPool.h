@@ -0,0 +1,59 @@
+#pragma once
+
+#include "VLCommandRecorder.h"
+#include "VLCommandStream.h"
+#include "VLDevice.h"
+#include "VLTlsfAllocator.h"
+#include "VLUploadEngine.h"
+
+#include <memory>
+
+namespace VulkanLearn
+{
+	// One vertex buffer and one index buffer that the geometry of many models is sub-allocated from.
+	// The renderer binds both once per frame and every model draws its own range through firstVertex/vertexOffset
+	// and firstIndex, which is also what multi-draw indirect needs.
+	// Note:	Vertex ranges are expressed in vertices and index ranges in indices (always VK_INDEX_TYPE_UINT32),
+	//			so the offsets can be passed to the draw calls as they are.
+	class VLMeshPool
+	{
+	public:
+		using Handle = VLTlsfBufferPool::Handle;
+		static constexpr Handle InvalidHandle = VLTlsfBufferPool::InvalidHandle;
+
+		// MaxIndices can be 0 for a pool that only holds non-indexed geometry
+		VLMeshPool(VLDevice& InDevice, VkDeviceSize MaxVertices, VkDeviceSize VertexStride, VkDeviceSize MaxIndices);
+
+		VLMeshPool(const VLMeshPool&) = delete;
+		VLMeshPool(VLMeshPool&&) = delete;
+		VLMeshPool& operator=(const VLMeshPool&) = delete;
+		VLMeshPool& operator=(VLMeshPool&&) = delete;
+
+		// Allocate a range and record the upload of its data, throws when the pool is full
+		Handle AllocateVertices(const void* Vertices, uint32_t VertexCount, VLUploadTicket& OutTicket);
+		Handle AllocateIndices(const uint32_t* Indices, uint32_t IndexCount, VLUploadTicket& OutTicket);
+		void FreeVertices(Handle Vertices) { VertexPool->Free(Vertices); }
+		void FreeIndices(Handle Indices) { IndexPool->Free(Indices); }
+
+		int32_t GetVertexOffset(Handle Vertices) const { return static_cast<int32_t>(VertexPool->GetOffset(Vertices)); }
+		uint32_t GetFirstIndex(Handle Indices) const { return static_cast<uint32_t>(IndexPool->GetOffset(Indices)); }
+
+		// Binds the shared vertex buffer to binding 0 and the shared index buffer
+		void Bind(VkCommandBuffer CommandBuffer);
+		void Bind(VLCommandRecorder& Recorder);
+		void Bind(VLCommandStream& Stream);
+
+		// Compacts the vertex and index buffer by up to MaxBytes in total, see VLTlsfBufferPool::Defragment.
+		// Returns true when any range moved, command buffers recorded with the old offsets have to be re-recorded.
+		bool Defragment(VkCommandBuffer CommandBuffer, VkDeviceSize MaxBytes);
+
+		VLTlsfBufferPool& GetVertexPool() { return *VertexPool; }
+		VLTlsfBufferPool* GetIndexPool() { return IndexPool.get(); }
+
+	private:
+
+		VLDevice& Device;
+		std::unique_ptr<VLTlsfBufferPool> VertexPool;
+		std::unique_ptr<VLTlsfBufferPool> IndexPool;
+	};
+}
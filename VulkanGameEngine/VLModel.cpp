@@ -1,4 +1,5 @@
 #include "VLModel.h"
+#include "VLStreamingCopy.h"
 
 #include <cassert>
 #include <cstring>
@@ -34,30 +35,218 @@ namespace VulkanLearn
 		return bindingDescriptions;
 	}
 
+	std::vector<VkVertexInputAttributeDescription> VLModel::Instance::GetAttributeDescriptions()
+	{
+		return {
+			{2, InstanceBinding, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, Transform)},
+			{3, InstanceBinding, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, Transform) + sizeof(glm::vec2)},
+			{4, InstanceBinding, VK_FORMAT_R32G32_SFLOAT, offsetof(Instance, Offset)},
+			{5, InstanceBinding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Instance, Color)}};
+	}
+
+	std::vector<VkVertexInputBindingDescription> VLModel::Instance::GetBindingDescriptions()
+	{
+		// VK_VERTEX_INPUT_RATE_INSTANCE:	Move to the next entry after each instance
+		return { {InstanceBinding, sizeof(Instance), VK_VERTEX_INPUT_RATE_INSTANCE} };
+	}
+
+	void VLModel::BindInstances(VkCommandBuffer commandBuffer, VkBuffer InstanceBuffer, VkDeviceSize Offset)
+	{
+		vkCmdBindVertexBuffers(commandBuffer, InstanceBinding, 1, &InstanceBuffer, &Offset);
+	}
+
+	void VLModel::BindInstances(VLCommandRecorder& Recorder, VkBuffer InstanceBuffer, VkDeviceSize Offset)
+	{
+		Recorder.BindVertexBuffers(InstanceBinding, 1, &InstanceBuffer, &Offset);
+	}
+
+	void VLModel::BindInstances(VLCommandStream& Stream, VkBuffer InstanceBuffer, VkDeviceSize Offset)
+	{
+		Stream.BindVertexBuffer(InstanceBinding, InstanceBuffer, Offset);
+	}
+
 	VLModel::VLModel(VLDevice& InDevice, const std::vector<Vertex>& Vertices):
 		Device(InDevice)
 	{
 		CreateVertexBuffers(Vertices);
 	}
 
+	VLModel::VLModel(VLDevice& InDevice, VLMeshPool& InMeshPool, const std::vector<Vertex>& Vertices,
+		const std::vector<uint32_t>& Indices) :
+		Device(InDevice),
+		pMeshPool(&InMeshPool)
+	{
+		VertexCount = static_cast<uint32_t>(Vertices.size());
+		assert(VertexCount >= 3 && "Vertex count must be at least 3");
+		VertexRange = pMeshPool->AllocateVertices(Vertices.data(), VertexCount, UploadTicket);
+
+		// Note:	Both uploads land in the same batch, so the last ticket covers the vertices as well
+		IndexCount = static_cast<uint32_t>(Indices.size());
+		if (IndexCount > 0)
+		{
+			IndexRange = pMeshPool->AllocateIndices(Indices.data(), IndexCount, UploadTicket);
+		}
+	}
+
 	VLModel::~VLModel()
 	{
-		vkDestroyBuffer(Device.GetDevice(), VertexBuffer, nullptr);
-		vkFreeMemory(Device.GetDevice(), VertexBufferMemory, nullptr);
+		Device.GetUploadEngine().Wait(UploadTicket);
+		if (pMeshPool != nullptr)
+		{
+			pMeshPool->FreeVertices(VertexRange);
+			if (IndexRange != VLMeshPool::InvalidHandle)
+			{
+				pMeshPool->FreeIndices(IndexRange);
+			}
+			return;
+		}
+		if (ResidencyHandle != VLResidencyManager::InvalidHandle)
+		{
+			pResidencyManager->Unregister(ResidencyHandle);
+		}
+		if (VertexBuffer != VK_NULL_HANDLE)
+		{
+			// Note:	Frames in flight may still draw the model
+			Device.DeferDestroyBuffer(VertexBuffer, VertexBufferAllocation);
+		}
+	}
+
+	void VLModel::EnableResidency(VLResidencyManager& Manager, const std::vector<Vertex>& Vertices)
+	{
+		assert(pMeshPool == nullptr && "Pooled models can't be evicted on their own");
+		assert(pResidencyManager == nullptr && "Residency is already enabled");
+		assert(Vertices.size() == VertexCount && "Vertices must be the ones the model was created with");
+		pResidencyManager = &Manager;
+		HostVertices = Vertices;
+		RegisterResidency();
+	}
+
+	void VLModel::RegisterResidency()
+	{
+		ResidencyHandle = pResidencyManager->Register(VertexBufferAllocation, [this]() { EvictVertexBuffers(); });
+	}
+
+	void VLModel::EvictVertexBuffers()
+	{
+		// Note:	The manager only evicts once the GPU has completed the last frame that touched the buffer, but
+		//			the upload itself may still be pending when the model was never drawn
+		Device.GetUploadEngine().Wait(UploadTicket);
+		vkDestroyBuffer(Device.GetDevice(), VertexBuffer, Device.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+		Device.FreeMemory(VertexBufferAllocation);
+		VertexBuffer = VK_NULL_HANDLE;
+		ResidencyHandle = VLResidencyManager::InvalidHandle;
 	}
 
 	void VLModel::Bind(VkCommandBuffer commandBuffer)
 	{
+		VLCommandRecorder recorder{ commandBuffer };
+		Bind(recorder);
+	}
+
+	void VLModel::Bind(VLCommandRecorder& Recorder)
+	{
+		if (pMeshPool != nullptr)
+		{
+			pMeshPool->Bind(Recorder);
+			return;
+		}
+
+		assert(IsResident() && "Call MakeResident before recording the model");
+
 		VkBuffer buffers[] = { VertexBuffer };
 		VkDeviceSize offsets[] = { 0 };
 		// Record to our command buffer to bind 1 vertex buffer starting at 0. 
 		// Note:	For multiple bindings, add additional elements to these arrays.
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, buffers, offsets);
+		Recorder.BindVertexBuffers(0, 1, buffers, offsets);
 	}
 	
-	void VLModel::Draw(VkCommandBuffer commandBuffer)
+	void VLModel::Bind(VLCommandStream& Stream)
+	{
+		if (pMeshPool != nullptr)
+		{
+			pMeshPool->Bind(Stream);
+			return;
+		}
+
+		assert(IsResident() && "Call MakeResident before recording the model");
+		Stream.BindVertexBuffer(0, VertexBuffer);
+	}
+
+	bool VLModel::MakeResident()
+	{
+		if (pResidencyManager == nullptr)
+		{
+			return false;
+		}
+
+		// Note:	The upload is recorded in the pending batch, which the swap chain submits ahead of this frame
+		bool bStreamedIn = false;
+		if (VertexBuffer == VK_NULL_HANDLE)
+		{
+			CreateVertexBuffers(HostVertices);
+			RegisterResidency();
+			bStreamedIn = true;
+		}
+		pResidencyManager->Touch(ResidencyHandle);
+		return bStreamedIn;
+	}
+
+	void VLModel::Draw(VkCommandBuffer commandBuffer, uint32_t InstanceCount, uint32_t FirstInstance)
+	{
+		if (pMeshPool == nullptr)
+		{
+			vkCmdDraw(commandBuffer, VertexCount, InstanceCount, 0, FirstInstance);
+			return;
+		}
+
+		// Note:	The pool may move our ranges while defragmenting, so the offsets are fetched at record time
+		const int32_t vertexOffset = pMeshPool->GetVertexOffset(VertexRange);
+		if (IndexCount > 0)
+		{
+			vkCmdDrawIndexed(commandBuffer, IndexCount, InstanceCount, pMeshPool->GetFirstIndex(IndexRange), vertexOffset,
+				FirstInstance);
+		}
+		else
+		{
+			vkCmdDraw(commandBuffer, VertexCount, InstanceCount, static_cast<uint32_t>(vertexOffset), FirstInstance);
+		}
+	}
+
+	void VLModel::Draw(VLCommandStream& Stream, uint32_t InstanceCount, uint32_t FirstInstance) const
+	{
+		if (IsIndexed())
+		{
+			const VkDrawIndexedIndirectCommand command = GetDrawIndexedIndirectCommand(InstanceCount, FirstInstance);
+			Stream.DrawIndexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset,
+				command.firstInstance);
+			return;
+		}
+		const VkDrawIndirectCommand command = GetDrawIndirectCommand(InstanceCount, FirstInstance);
+		Stream.Draw(command.vertexCount, command.instanceCount, command.firstVertex, command.firstInstance);
+	}
+
+	VkDrawIndirectCommand VLModel::GetDrawIndirectCommand(uint32_t InstanceCount, uint32_t FirstInstance) const
+	{
+		assert(!IsIndexed() && "Indexed models need a VkDrawIndexedIndirectCommand");
+		VkDrawIndirectCommand command{};
+		command.vertexCount = VertexCount;
+		command.instanceCount = InstanceCount;
+		command.firstVertex = pMeshPool != nullptr ? static_cast<uint32_t>(pMeshPool->GetVertexOffset(VertexRange)) : 0;
+		command.firstInstance = FirstInstance;
+		return command;
+	}
+
+	VkDrawIndexedIndirectCommand VLModel::GetDrawIndexedIndirectCommand(
+		uint32_t InstanceCount, uint32_t FirstInstance) const
 	{
-		vkCmdDraw(commandBuffer, VertexCount, 1, 0, 0);
+		assert(IsIndexed() && "Model has no indices");
+		VkDrawIndexedIndirectCommand command{};
+		command.indexCount = IndexCount;
+		command.instanceCount = InstanceCount;
+		command.firstIndex = pMeshPool->GetFirstIndex(IndexRange);
+		command.vertexOffset = pMeshPool->GetVertexOffset(VertexRange);
+		command.firstInstance = FirstInstance;
+		return command;
 	}
 
 	void VLModel::CreateVertexBuffers(const std::vector<Vertex>& Vertices)
@@ -66,25 +255,38 @@ namespace VulkanLearn
 		assert(VertexCount >= 3 && "Vertex count must be at least 3");
 		VkDeviceSize bufferSize = sizeof(Vertices[0]) * VertexCount;
 
-		// VK_BUFFER_USAGE_VERTEX_BUFFER_BIT:	Buffer will be used to hold vertex input data
-		// VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT:	Allocated memory should be accessible from our host (CPU)
-		//										This way, we can write to the device memory
-		// VK_MEMORY_PROPERTY_HOST_COHERENT_BIT:	Keep host and device memory regents consistent with each other
+		// Note:	On UMA devices device local memory is host visible as well, so write the vertices in place
+		if (Device.IsUnifiedMemory())
+		{
+			// VK_BUFFER_USAGE_VERTEX_BUFFER_BIT:	Buffer will be used to hold vertex input data
+			// VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT:	Allocated memory should be accessible from our host (CPU)
+			//										This way, we can write to the device memory
+			// VK_MEMORY_PROPERTY_HOST_COHERENT_BIT:	Keep host and device memory regents consistent with each other
+			Device.CreateBuffer(
+				bufferSize,
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+				VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				VertexBuffer,
+				VertexBufferAllocation);
+
+			// Note:	The allocator keeps host visible blocks mapped for their whole lifetime, so pMapped already
+			//			points to the beginning of our range. Mapping the shared memory object again would be invalid.
+			VLStreamingCopy(VertexBufferAllocation.pMapped, Vertices.data(), static_cast<size_t>(bufferSize));
+			return;
+		}
+
+		// Note:	On discrete GPUs host visible memory lives in system RAM, so every vertex fetch would go over PCIe.
+		//			Write the vertices to a staging buffer instead and let the GPU copy them into device local memory.
 		Device.CreateBuffer(
-			bufferSize, 
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-			VertexBuffer, 
-			VertexBufferMemory);
-
-		// Create a region of host memory mapped to device memory + Point to the beginning  of the mapped memory range
-		void* data;
-		vkMapMemory(Device.GetDevice(), VertexBufferMemory, 0, bufferSize, 0, &data);
-
-		// Take Vertices data and copy into the Host-Mapped memory region
-		// Note:	Without VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vkFlushMappedMemoryRanges is required to propagate 
-		//			changes from host to device.
-		memcpy(data, Vertices.data(), static_cast<size_t>(bufferSize));
-		vkUnmapMemory(Device.GetDevice(), VertexBufferMemory);
+			bufferSize,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			VertexBuffer,
+			VertexBufferAllocation);
+
+		// Note:	The upload engine copies the vertices into its own staging memory and only records the copy.
+		//			Nothing waits here, the owner submits the batch once all models are loaded.
+		UploadTicket = Device.GetUploadEngine().UploadToBuffer(Vertices.data(), bufferSize, VertexBuffer);
 	}
 }
@@ -5,15 +5,19 @@
 #include <glm/glm.hpp>
 #include <vector>
 
+#include "VLCommandRecorder.h"
+#include "VLCommandStream.h"
 #include "VLDevice.h"
+#include "VLMeshPool.h"
+#include "VLResidencyManager.h"
+#include "VLUploadEngine.h"
 
 namespace VulkanLearn
 {
 
-	// TODO:	This Model class will quickly run into the max memory allocation limits for complex scenes with many
-	//			different types of models.
-	//			Solution: Allocate bigger parts of memory and assign parts of them to particular resources.
-	//			Possible Reference: https://kylehalladay.com/blog/tutorial/2017/12/13/Custom-Allocators-Vulkan.html
+	// Note:	Vertex memory is sub-allocated from the device's VLMemoryAllocator blocks, so many models don't run
+	//			into the max memory allocation limits.
+	//			Reference: https://kylehalladay.com/blog/tutorial/2017/12/13/Custom-Allocators-Vulkan.html
 
 	class VLModel
 	{
@@ -27,23 +31,82 @@ namespace VulkanLearn
 			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
 		};
 
+		// Per-instance data, read from binding 1 once per instance instead of once per vertex
+		// Note:	Locations continue after the ones of Vertex, the 2x2 transform takes one location per column
+		struct Instance
+		{
+			glm::mat2 Transform;
+			glm::vec2 Offset;
+			glm::vec3 Color;
+			static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
+		};
+		static constexpr uint32_t InstanceBinding = 1;
+		// Binds a buffer of Instance structs, draws with an instance count read consecutive entries from Offset on
+		static void BindInstances(VkCommandBuffer commandBuffer, VkBuffer InstanceBuffer, VkDeviceSize Offset = 0);
+		static void BindInstances(VLCommandRecorder& Recorder, VkBuffer InstanceBuffer, VkDeviceSize Offset = 0);
+		static void BindInstances(VLCommandStream& Stream, VkBuffer InstanceBuffer, VkDeviceSize Offset = 0);
+
 		VLModel(VLDevice& InDevice, const std::vector<Vertex>& Vertices);
+		// Places the geometry in the shared buffers of MeshPool instead of a buffer of its own
+		// Note:	The pool must outlive the model
+		VLModel(VLDevice& InDevice, VLMeshPool& InMeshPool, const std::vector<Vertex>& Vertices,
+			const std::vector<uint32_t>& Indices = {});
 		~VLModel();
 
 		VLModel(const VLModel&) = delete;
 		VLModel(VLModel&&) = delete;
 		VLModel& operator=(const VLModel&) = delete;
 
+		// Pooled models can skip this when the pool has been bound already
+		// Note:	Models with residency enabled must have been made resident for the frame, Bind never streams in
 		void Bind(VkCommandBuffer commandBuffer);
-		void Draw(VkCommandBuffer commandBuffer);
+		void Bind(VLCommandRecorder& Recorder);
+		void Bind(VLCommandStream& Stream);
+		void Draw(VkCommandBuffer commandBuffer, uint32_t InstanceCount = 1, uint32_t FirstInstance = 0);
+		void Draw(VLCommandStream& Stream, uint32_t InstanceCount = 1, uint32_t FirstInstance = 0) const;
+
+		bool IsPooled() const { return pMeshPool != nullptr; }
+		bool IsIndexed() const { return IndexCount > 0; }
+		// The arguments Draw() would pass, for an indirect draw buffer. The geometry must be bound when drawing.
+		VkDrawIndirectCommand GetDrawIndirectCommand(uint32_t InstanceCount = 1, uint32_t FirstInstance = 0) const;
+		VkDrawIndexedIndirectCommand GetDrawIndexedIndirectCommand(
+			uint32_t InstanceCount = 1, uint32_t FirstInstance = 0) const;
+		// Models with the same geometry source bind the same buffers, the pool for pooled models
+		const void* GetGeometrySource() const
+		{
+			return pMeshPool != nullptr ? static_cast<const void*>(pMeshPool) : static_cast<const void*>(this);
+		}
+
+		// Lets the residency manager evict the vertex buffer when the heap runs low. The model keeps a host copy of
+		// its vertices and streams them back in from MakeResident().
+		// Note:	Standalone models only, pooled geometry shares one allocation. The manager must outlive the model.
+		void EnableResidency(VLResidencyManager& Manager, const std::vector<Vertex>& Vertices);
+		bool IsResident() const { return VertexBuffer != VK_NULL_HANDLE || pMeshPool != nullptr; }
+		// Streams the vertices back in when they were evicted and marks them as used by the frame being recorded.
+		// Call on the main thread before recording, for every frame that submits the model, cached command buffers
+		// included. Returns true when the vertex buffer was recreated, recordings of the old one have to be redone.
+		bool MakeResident();
 
 	private:
 
 		void CreateVertexBuffers(const std::vector<Vertex>& Vertices);
+		void RegisterResidency();
+		void EvictVertexBuffers();
 
 		VLDevice& Device;
-		VkBuffer VertexBuffer;
-		VkDeviceMemory VertexBufferMemory;
+		VkBuffer VertexBuffer = VK_NULL_HANDLE;
+		VLAllocation VertexBufferAllocation;
+		VLMeshPool* pMeshPool = nullptr;
+		VLMeshPool::Handle VertexRange = VLMeshPool::InvalidHandle;
+		VLMeshPool::Handle IndexRange = VLMeshPool::InvalidHandle;
+		// Batch the vertex upload was recorded in, the buffer can't be destroyed before it completed
+		VLUploadTicket UploadTicket;
 		uint32_t VertexCount;
+		uint32_t IndexCount = 0;
+		VLResidencyManager* pResidencyManager = nullptr;
+		VLResidencyManager::Handle ResidencyHandle = VLResidencyManager::InvalidHandle;
+		// Only kept while residency is enabled, the source to stream back in from after an eviction
+		std::vector<Vertex> HostVertices;
 	};
 }
@@ -0,0 +1,238 @@
+#include "VLParallelRecorder.h"
+
+// std headers
+#include <algorithm>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLParallelRecorder::VLParallelRecorder(VLDevice& InDevice, uint32_t InFrameCount, uint32_t InThreadCount) :
+		Device{ InDevice },
+		FrameCount{ InFrameCount },
+		ThreadCount{ InThreadCount }
+	{
+		if (ThreadCount == 0)
+		{
+			ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		// Note:	The pools only ever hold buffers that are recorded once and reset all at once
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = Device.FindPhysicalQueueFamilies().GraphicsFamily.value();
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		CommandPools.resize(static_cast<size_t>(FrameCount) * ThreadCount);
+		for (ThreadCommandPool& commandPool : CommandPools)
+		{
+			if (vkCreateCommandPool(Device.GetDevice(), &poolInfo,
+				Device.GetAllocationCallbacks(VLHostAllocationCategory::Device), &commandPool.Pool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create recording command pool!");
+			}
+		}
+
+		Workers.reserve(ThreadCount - 1);
+		for (uint32_t threadIndex = 1; threadIndex < ThreadCount; threadIndex++)
+		{
+			Workers.emplace_back(&VLParallelRecorder::WorkerLoop, this, threadIndex);
+		}
+	}
+
+	VLParallelRecorder::~VLParallelRecorder()
+	{
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			bStopping = true;
+		}
+		WorkAvailable.notify_all();
+		for (std::thread& worker : Workers)
+		{
+			worker.join();
+		}
+
+		// Note:	Frames in flight may still execute secondaries of these pools, destroying a pool frees its buffers
+		std::vector<VkCommandPool> pools;
+		for (ThreadCommandPool& commandPool : CommandPools)
+		{
+			pools.push_back(commandPool.Pool);
+		}
+		Device.DeferDestroy([&Device = Device, pools]()
+			{
+				for (VkCommandPool pool : pools)
+				{
+					vkDestroyCommandPool(Device.GetDevice(), pool,
+						Device.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+				}
+			});
+	}
+
+	void VLParallelRecorder::BeginFrame(size_t FrameIndex)
+	{
+		CurrentFrame = FrameIndex;
+		for (uint32_t threadIndex = 0; threadIndex < ThreadCount; threadIndex++)
+		{
+			ThreadCommandPool& commandPool = CommandPools[CurrentFrame * ThreadCount + threadIndex];
+			if (commandPool.UsedBufferCount > 0)
+			{
+				vkResetCommandPool(Device.GetDevice(), commandPool.Pool, 0);
+				commandPool.UsedBufferCount = 0;
+			}
+		}
+	}
+
+	void VLParallelRecorder::Record(
+		VkCommandBuffer PrimaryBuffer,
+		VkRenderPass RenderPass,
+		uint32_t Subpass,
+		VkFramebuffer Framebuffer,
+		uint32_t ItemCount,
+		const RecordFunction& Function)
+	{
+		if (ItemCount == 0)
+		{
+			return;
+		}
+
+		const uint32_t sliceCount = std::clamp(ItemCount / MinItemsPerSlice, 1u, ThreadCount);
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			pJobFunction = &Function;
+			JobInheritance = {};
+			JobInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			JobInheritance.renderPass = RenderPass;
+			JobInheritance.subpass = Subpass;
+			JobInheritance.framebuffer = Framebuffer;
+			JobItemCount = ItemCount;
+			JobSliceCount = sliceCount;
+			JobSecondaryBuffers.assign(sliceCount, VK_NULL_HANDLE);
+			JobException = nullptr;
+
+			if (sliceCount > 1)
+			{
+				PendingWorkers = sliceCount - 1;
+				JobGeneration++;
+			}
+		}
+		if (sliceCount > 1)
+		{
+			WorkAvailable.notify_all();
+		}
+
+		// The calling thread takes the first slice instead of idling
+		try
+		{
+			RecordSlice(0);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(Mutex);
+			JobException = std::current_exception();
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(Mutex);
+			WorkFinished.wait(lock, [this]() { return PendingWorkers == 0; });
+			if (JobException)
+			{
+				std::rethrow_exception(JobException);
+			}
+		}
+
+		vkCmdExecuteCommands(PrimaryBuffer, sliceCount, JobSecondaryBuffers.data());
+	}
+
+	void VLParallelRecorder::WorkerLoop(uint32_t ThreadIndex)
+	{
+		uint64_t handledGeneration = 0;
+		while (true)
+		{
+			uint32_t sliceCount;
+			{
+				std::unique_lock<std::mutex> lock(Mutex);
+				WorkAvailable.wait(lock, [&]() { return bStopping || JobGeneration != handledGeneration; });
+				if (bStopping)
+				{
+					return;
+				}
+				handledGeneration = JobGeneration;
+				sliceCount = JobSliceCount;
+			}
+
+			// Note:	Small jobs don't need every thread
+			if (ThreadIndex >= sliceCount)
+			{
+				continue;
+			}
+
+			std::exception_ptr exception;
+			try
+			{
+				RecordSlice(ThreadIndex);
+			}
+			catch (...)
+			{
+				exception = std::current_exception();
+			}
+
+			std::lock_guard<std::mutex> lock(Mutex);
+			if (exception)
+			{
+				JobException = exception;
+			}
+			if (--PendingWorkers == 0)
+			{
+				WorkFinished.notify_one();
+			}
+		}
+	}
+
+	void VLParallelRecorder::RecordSlice(uint32_t ThreadIndex)
+	{
+		const uint32_t firstItem = static_cast<uint32_t>(uint64_t(JobItemCount) * ThreadIndex / JobSliceCount);
+		const uint32_t endItem = static_cast<uint32_t>(uint64_t(JobItemCount) * (ThreadIndex + 1) / JobSliceCount);
+
+		VkCommandBuffer commandBuffer = AcquireSecondaryBuffer(ThreadIndex);
+
+		// VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT:	The buffer runs entirely inside the render pass
+		//														of the primary buffer
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags =
+			VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &JobInheritance;
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+		}
+
+		(*pJobFunction)(commandBuffer, ThreadIndex, firstItem, endItem - firstItem);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+		JobSecondaryBuffers[ThreadIndex] = commandBuffer;
+	}
+
+	VkCommandBuffer VLParallelRecorder::AcquireSecondaryBuffer(uint32_t ThreadIndex)
+	{
+		ThreadCommandPool& commandPool = CommandPools[CurrentFrame * ThreadCount + ThreadIndex];
+		if (commandPool.UsedBufferCount == commandPool.Buffers.size())
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = commandPool.Pool;
+			allocInfo.commandBufferCount = 1;
+
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate secondary command buffer!");
+			}
+			commandPool.Buffers.push_back(commandBuffer);
+		}
+		return commandPool.Buffers[commandPool.UsedBufferCount++];
+	}
+}
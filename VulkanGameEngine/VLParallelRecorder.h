@@ -0,0 +1,95 @@
+#pragma once
+
+#include "VLDevice.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Spreads the recording of a draw list over worker threads. Every thread records its slice into a secondary
+	// command buffer allocated from a pool only that thread uses, the primary buffer then executes the slices in order
+	// with vkCmdExecuteCommands.
+	// Note:	Command pools are externally synchronized, so every thread gets its own pool per frame in flight.
+	//			Resetting a whole pool once its frame slot comes round again is far cheaper than resetting buffers one
+	//			by one, but it means the secondaries only live for one frame: primaries that execute them have to be
+	//			re-recorded every frame.
+	class VLParallelRecorder
+	{
+	public:
+		// Records the items [FirstItem, FirstItem + ItemCount) of the draw list into CommandBuffer
+		// Note:	Called concurrently from different threads. Bound pipelines and dynamic state (viewport, scissor)
+		//			are not inherited from the primary buffer, every slice has to set them itself.
+		//			SliceIndex is below GetThreadCount() and unique among the concurrent calls, so it can pick
+		//			scratch data (e.g. a VLCommandStream) that only this slice uses.
+		using RecordFunction = std::function<void(VkCommandBuffer CommandBuffer, uint32_t SliceIndex, uint32_t FirstItem,
+			uint32_t ItemCount)>;
+
+		// InThreadCount:	Threads recording in parallel including the calling one, 0 uses every hardware thread
+		VLParallelRecorder(VLDevice& InDevice, uint32_t InFrameCount, uint32_t InThreadCount = 0);
+		~VLParallelRecorder();
+
+		VLParallelRecorder(const VLParallelRecorder&) = delete;
+		VLParallelRecorder(VLParallelRecorder&&) = delete;
+		VLParallelRecorder& operator=(const VLParallelRecorder&) = delete;
+		VLParallelRecorder& operator=(VLParallelRecorder&&) = delete;
+
+		// Resets the pools of the frame slot, the frame that used them last must have completed
+		void BeginFrame(size_t FrameIndex);
+		// Records ItemCount items in slices of at least MinItemsPerSlice and executes them in PrimaryBuffer.
+		// PrimaryBuffer must be inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+		void Record(
+			VkCommandBuffer PrimaryBuffer,
+			VkRenderPass RenderPass,
+			uint32_t Subpass,
+			VkFramebuffer Framebuffer,
+			uint32_t ItemCount,
+			const RecordFunction& Function);
+
+		uint32_t GetThreadCount() const { return ThreadCount; }
+
+		// Below this many draws per thread, waking another worker costs more than it saves
+		static constexpr uint32_t MinItemsPerSlice = 256;
+
+	private:
+		struct ThreadCommandPool
+		{
+			VkCommandPool Pool = VK_NULL_HANDLE;
+			std::vector<VkCommandBuffer> Buffers;
+			uint32_t UsedBufferCount = 0;
+		};
+
+		void WorkerLoop(uint32_t ThreadIndex);
+		// Records the slice with the same index as the thread into a secondary buffer of the thread's pool
+		void RecordSlice(uint32_t ThreadIndex);
+		VkCommandBuffer AcquireSecondaryBuffer(uint32_t ThreadIndex);
+
+		VLDevice& Device;
+		uint32_t FrameCount;
+		uint32_t ThreadCount;
+		size_t CurrentFrame = 0;
+		// Indexed by [FrameIndex * ThreadCount + ThreadIndex]
+		std::vector<ThreadCommandPool> CommandPools;
+
+		// Thread 0 is the calling thread, Workers[i] records as thread i + 1
+		std::vector<std::thread> Workers;
+		std::mutex Mutex;
+		std::condition_variable WorkAvailable;
+		std::condition_variable WorkFinished;
+		uint64_t JobGeneration = 0;
+		uint32_t PendingWorkers = 0;
+		bool bStopping = false;
+
+		// Note:	Written under the mutex before a job is published and left alone until every worker is done
+		const RecordFunction* pJobFunction = nullptr;
+		VkCommandBufferInheritanceInfo JobInheritance{};
+		uint32_t JobItemCount = 0;
+		uint32_t JobSliceCount = 0;
+		std::vector<VkCommandBuffer> JobSecondaryBuffers;
+		std::exception_ptr JobException;
+	};
+}
@@ -18,9 +18,15 @@ namespace VulkanLearn {
 
 	VLPipeline::~VLPipeline()
 	{
-		vkDestroyShaderModule(Device.GetDevice(), VertShaderModule, nullptr);
-		vkDestroyShaderModule(Device.GetDevice(), FragShaderModule, nullptr);
-		vkDestroyPipeline(Device.GetDevice(), GraphicsPipeline, nullptr);
+		// Note:	Frames in flight may still be using the pipeline (e.g. after a swap chain recreation)
+		Device.DeferDestroy(
+			[device = Device.GetDevice(), vert = VertShaderModule, frag = FragShaderModule, pipeline = GraphicsPipeline,
+			pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline)]()
+			{
+				vkDestroyShaderModule(device, vert, pAllocator);
+				vkDestroyShaderModule(device, frag, pAllocator);
+				vkDestroyPipeline(device, pipeline, pAllocator);
+			});
 	}
 
 	void VLPipeline::DefaultPipelineConfigInfo(PipelineConfigInfo& ConfigInfo)
@@ -93,6 +99,9 @@ namespace VulkanLearn {
 		ConfigInfo.DynamicStateInfo.dynamicStateCount =
 			static_cast<uint32_t>(ConfigInfo.DynamicStateEnables.size());
 		ConfigInfo.DynamicStateInfo.flags = 0;
+
+		ConfigInfo.BindingDescriptions = VLModel::Vertex::GetBindingDescriptions();
+		ConfigInfo.AttributeDescriptions = VLModel::Vertex::GetAttributeDescriptions();
 	}
 
 	void VLPipeline::Bind(VkCommandBuffer Commandbuffer)
@@ -101,6 +110,16 @@ namespace VulkanLearn {
 		vkCmdBindPipeline(Commandbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
 	}
 
+	void VLPipeline::Bind(VLCommandRecorder& Recorder)
+	{
+		Recorder.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
+	}
+
+	void VLPipeline::Bind(VLCommandStream& Stream)
+	{
+		Stream.BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, GraphicsPipeline);
+	}
+
 	std::vector<char> VLPipeline::ReadFile(const std::string& FilePath)
 	{
 		// ate:		Start reading at the end of the file
@@ -154,10 +173,8 @@ namespace VulkanLearn {
 		shaderStages[1].pNext = nullptr;
 		shaderStages[1].pSpecializationInfo = nullptr;
 
-		std::vector<VkVertexInputAttributeDescription> attributeDescriptions =
-			VLModel::Vertex::GetAttributeDescriptions();
-		std::vector<VkVertexInputBindingDescription> bindingDescriptions =
-			VLModel::Vertex::GetBindingDescriptions();
+		const std::vector<VkVertexInputAttributeDescription>& attributeDescriptions = ConfigInfo.AttributeDescriptions;
+		const std::vector<VkVertexInputBindingDescription>& bindingDescriptions = ConfigInfo.BindingDescriptions;
 
 		// Describe how to interpret the vertex buffer data 
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
@@ -201,8 +218,10 @@ namespace VulkanLearn {
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
 		// Note:	pipelineCache (now VK_NULL_HANDLE) could be used as a performance opimisation
+		// Note:	Compiling allocates lots of short lived memory in the driver, keep it in the arena
+		VLHostAllocator::ScopedArena arena;
 		if (vkCreateGraphicsPipelines(Device.GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo,
-			nullptr, &GraphicsPipeline) != VK_SUCCESS)
+			Device.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline), &GraphicsPipeline) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create graphics pipeline");
 		}
@@ -216,7 +235,8 @@ namespace VulkanLearn {
 		//			the worst case alignment. This would not have worked with a char array!
 		createInfo.pCode = reinterpret_cast<const uint32_t*>(Code.data());
 
-		if (vkCreateShaderModule(Device.GetDevice(), &createInfo, nullptr, pShaderModule) != VK_SUCCESS) {
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Pipeline);
+		if (vkCreateShaderModule(Device.GetDevice(), &createInfo, pAllocator, pShaderModule) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create shader module!");
 		}
 	}
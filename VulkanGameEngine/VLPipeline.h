@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 
+#include "VLCommandRecorder.h"
+#include "VLCommandStream.h"
 #include "VLDevice.h"
 
 
@@ -24,6 +26,10 @@ namespace VulkanLearn
 		VkPipelineDepthStencilStateCreateInfo DepthStencilInfo;
 		std::vector<VkDynamicState> DynamicStateEnables;
 		VkPipelineDynamicStateCreateInfo DynamicStateInfo;
+		// Vertex buffer bindings and the attributes read from them, the model vertex layout by default.
+		// Append VLModel::Instance's descriptions for a per-instance stream on binding 1.
+		std::vector<VkVertexInputBindingDescription> BindingDescriptions;
+		std::vector<VkVertexInputAttributeDescription> AttributeDescriptions;
 		VkPipelineLayout PipelineLayout = nullptr;
 		VkRenderPass RenderPass = nullptr;
 		uint32_t Subpass = 0;
@@ -42,6 +48,8 @@ namespace VulkanLearn
 
 		static void DefaultPipelineConfigInfo(PipelineConfigInfo& ConfigiInfo);
 		void Bind(VkCommandBuffer Commandbuffer);
+		void Bind(VLCommandRecorder& Recorder);
+		void Bind(VLCommandStream& Stream);
 
 	private:
 
@@ -0,0 +1,119 @@
+#include "VLRenderLayer.h"
+
+// std headers
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLRenderLayer::VLRenderLayer(VLDevice& InDevice, uint32_t InFrameCount, RecordFunction InRecord) :
+		Device{ InDevice },
+		RecordContents{ std::move(InRecord) }
+	{
+		// Note:	Not transient, the buffer is kept for many frames. Every slot has a pool with a single buffer,
+		//			so the whole pool is reset on a re-record instead of the buffer on its own.
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = Device.FindPhysicalQueueFamilies().GraphicsFamily.value();
+		poolInfo.flags = 0;
+
+		FrameSlots.resize(InFrameCount);
+		for (FrameSlot& slot : FrameSlots)
+		{
+			if (vkCreateCommandPool(Device.GetDevice(), &poolInfo,
+				Device.GetAllocationCallbacks(VLHostAllocationCategory::Device), &slot.CommandPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create layer command pool!");
+			}
+
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandPool = slot.CommandPool;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &slot.CommandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate layer command buffer!");
+			}
+		}
+	}
+
+	VLRenderLayer::~VLRenderLayer()
+	{
+		// Note:	Frames in flight may still execute the cached buffers, destroying a pool frees its buffer
+		std::vector<VkCommandPool> pools;
+		for (FrameSlot& slot : FrameSlots)
+		{
+			pools.push_back(slot.CommandPool);
+		}
+		Device.DeferDestroy([&Device = Device, pools]()
+			{
+				for (VkCommandPool pool : pools)
+				{
+					vkDestroyCommandPool(Device.GetDevice(), pool,
+						Device.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+				}
+			});
+	}
+
+	VkCommandBuffer VLRenderLayer::Prepare(size_t FrameIndex, VkRenderPass RenderPass, uint32_t Subpass)
+	{
+		FrameSlot& slot = FrameSlots[FrameIndex];
+		if (slot.RecordedVersion != Version || slot.RecordedRenderPass != RenderPass || slot.RecordedSubpass != Subpass)
+		{
+			Record(slot, RenderPass, Subpass);
+		}
+		return slot.CommandBuffer;
+	}
+
+	void VLRenderLayer::Execute(VkCommandBuffer CommandBuffer, const std::vector<VLRenderLayer*>& Layers,
+		size_t FrameIndex, VkRenderPass RenderPass, uint32_t Subpass)
+	{
+		std::vector<VkCommandBuffer> commandBuffers;
+		commandBuffers.reserve(Layers.size());
+		for (VLRenderLayer* pLayer : Layers)
+		{
+			commandBuffers.push_back(pLayer->Prepare(FrameIndex, RenderPass, Subpass));
+		}
+		if (!commandBuffers.empty())
+		{
+			vkCmdExecuteCommands(CommandBuffer, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+		}
+	}
+
+	void VLRenderLayer::Record(FrameSlot& Slot, VkRenderPass RenderPass, uint32_t Subpass)
+	{
+		// Note:	The frame that executed this buffer last has completed, as AcquireNextImage waited for it
+		vkResetCommandPool(Device.GetDevice(), Slot.CommandPool, 0);
+
+		// Note:	No framebuffer, the slot is executed with whichever swap chain image its frame acquired
+		VkCommandBufferInheritanceInfo inheritance{};
+		inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritance.renderPass = RenderPass;
+		inheritance.subpass = Subpass;
+		inheritance.framebuffer = VK_NULL_HANDLE;
+
+		// Note:	No VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, the buffer is executed by many frames.
+		//			No VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT either, only the frame of this slot executes it.
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritance;
+		if (vkBeginCommandBuffer(Slot.CommandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording layer command buffer!");
+		}
+
+		VLCommandRecorder recorder{ Slot.CommandBuffer };
+		RecordContents(recorder);
+
+		if (vkEndCommandBuffer(Slot.CommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record layer command buffer!");
+		}
+
+		Slot.RecordedVersion = Version;
+		Slot.RecordedRenderPass = RenderPass;
+		Slot.RecordedSubpass = Subpass;
+		RecordCount++;
+	}
+}
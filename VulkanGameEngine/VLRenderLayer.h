@@ -0,0 +1,66 @@
+#pragma once
+
+#include "VLCommandRecorder.h"
+#include "VLDevice.h"
+
+#include <functional>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// A part of the frame (background, HUD, static world chunks, ...) recorded into a secondary command buffer of its
+	// own that is kept across frames. The buffer is only re-recorded once Invalidate() was called, so the cost of a
+	// frame scales with what changed instead of with the size of the scene.
+	// Note:	Every frame in flight slot has its own buffer, as the one executed by the previous frame may still be
+	//			in use. The slots catch up one by one after an Invalidate().
+	//			A cached recording keeps referring to the buffers, pipelines and descriptor sets it was recorded with,
+	//			invalidate the layer whenever one of them is replaced. Per-frame (ring) allocations can't be used.
+	class VLRenderLayer
+	{
+	public:
+		// Records the contents of the layer, no state is inherited so the function sets everything it uses
+		using RecordFunction = std::function<void(VLCommandRecorder& Recorder)>;
+
+		VLRenderLayer(VLDevice& InDevice, uint32_t InFrameCount, RecordFunction InRecord);
+		~VLRenderLayer();
+
+		VLRenderLayer(const VLRenderLayer&) = delete;
+		VLRenderLayer(VLRenderLayer&&) = delete;
+		VLRenderLayer& operator=(const VLRenderLayer&) = delete;
+		VLRenderLayer& operator=(VLRenderLayer&&) = delete;
+
+		// Marks the contents as changed, every slot re-records the next time it is prepared
+		void Invalidate() { Version++; }
+		uint64_t GetVersion() const { return Version; }
+
+		// Returns the secondary command buffer of the frame slot, re-recording it first when it is out of date
+		// Note:	Only call this once the previous frame of FrameIndex has completed
+		VkCommandBuffer Prepare(size_t FrameIndex, VkRenderPass RenderPass, uint32_t Subpass);
+		// Prepares the layers and executes them in order, CommandBuffer has to be inside a subpass begun with
+		// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+		static void Execute(VkCommandBuffer CommandBuffer, const std::vector<VLRenderLayer*>& Layers, size_t FrameIndex,
+			VkRenderPass RenderPass, uint32_t Subpass);
+
+		// Times a slot was recorded, how often a layer recorded compared to the frames drawn shows what the cache saves
+		uint32_t GetRecordCount() const { return RecordCount; }
+
+	private:
+		struct FrameSlot
+		{
+			VkCommandPool CommandPool = VK_NULL_HANDLE;
+			VkCommandBuffer CommandBuffer = VK_NULL_HANDLE;
+			// Version and render pass the buffer was recorded with, version 0 is never recorded
+			uint64_t RecordedVersion = 0;
+			VkRenderPass RecordedRenderPass = VK_NULL_HANDLE;
+			uint32_t RecordedSubpass = 0;
+		};
+
+		void Record(FrameSlot& Slot, VkRenderPass RenderPass, uint32_t Subpass);
+
+		VLDevice& Device;
+		RecordFunction RecordContents;
+		std::vector<FrameSlot> FrameSlots;
+		uint64_t Version = 1;
+		uint32_t RecordCount = 0;
+	};
+}
@@ -0,0 +1,154 @@
+#include "VLRenderQueue.h"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace VulkanLearn
+{
+	uint64_t VLRenderQueue::MakeSortKey(
+		uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t Mesh, uint32_t Depth)
+	{
+		assert(Pass < (1u << 4) && Pipeline < (1u << 12) && Material < (1u << 12) && Mesh < (1u << 16) &&
+			Depth < (1u << 20) && "Sort key field out of range");
+		return (uint64_t(Pass) << 60) |
+			(uint64_t(Pipeline) << 48) |
+			(uint64_t(Material) << 36) |
+			(uint64_t(Mesh) << 20) |
+			uint64_t(Depth);
+	}
+
+	uint32_t VLRenderQueue::QuantizeDepth(float Depth)
+	{
+		const float clamped = std::clamp(Depth, 0.0f, 1.0f);
+		return static_cast<uint32_t>(clamped * float((1u << 20) - 1));
+	}
+
+	void VLRenderQueue::Reset()
+	{
+		Draws.clear();
+		PushData.clear();
+		SortItems.clear();
+		EmittedDraws = 0;
+		PipelineBinds = 0;
+		GeometryBinds = 0;
+	}
+
+	void VLRenderQueue::Submit(uint64_t SortKey, VLPipeline& Pipeline, VLModel& Model, VkPipelineLayout Layout,
+		VkShaderStageFlags PushStages, const void* PushConstants, uint32_t PushSize)
+	{
+		Draw draw{};
+		draw.pPipeline = &Pipeline;
+		draw.pModel = &Model;
+		draw.Layout = Layout;
+		draw.PushStages = PushStages;
+		draw.PushOffset = static_cast<uint32_t>(PushData.size());
+		draw.PushSize = PushSize;
+		draw.InstanceCount = 1;
+		draw.FirstInstance = 0;
+		if (PushSize > 0)
+		{
+			PushData.resize(PushData.size() + PushSize);
+			std::memcpy(PushData.data() + draw.PushOffset, PushConstants, PushSize);
+		}
+		AddDraw(SortKey, draw);
+	}
+
+	void VLRenderQueue::SubmitInstanced(uint64_t SortKey, VLPipeline& Pipeline, VLModel& Model, uint32_t InstanceCount,
+		uint32_t FirstInstance)
+	{
+		Draw draw{};
+		draw.pPipeline = &Pipeline;
+		draw.pModel = &Model;
+		draw.InstanceCount = InstanceCount;
+		draw.FirstInstance = FirstInstance;
+		AddDraw(SortKey, draw);
+	}
+
+	void VLRenderQueue::AddDraw(uint64_t SortKey, const Draw& NewDraw)
+	{
+		SortItems.push_back({ SortKey, static_cast<uint32_t>(Draws.size()) });
+		Draws.push_back(NewDraw);
+	}
+
+	void VLRenderQueue::Sort()
+	{
+		// Note:	LSD radix sort on 8 bits at a time, stable so draws with equal keys keep their submission order.
+		//			Bytes that are the same for every draw (e.g. the pass in a single pass frame) are skipped.
+		const size_t count = SortItems.size();
+		SortScratch.resize(count);
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			uint32_t histogram[256] = {};
+			for (const SortItem& item : SortItems)
+			{
+				histogram[(item.Key >> shift) & 0xFF]++;
+			}
+			if (count == 0 || histogram[(SortItems[0].Key >> shift) & 0xFF] == count)
+			{
+				continue;
+			}
+
+			uint32_t offset = 0;
+			for (uint32_t& bucket : histogram)
+			{
+				const uint32_t bucketSize = bucket;
+				bucket = offset;
+				offset += bucketSize;
+			}
+			for (const SortItem& item : SortItems)
+			{
+				SortScratch[histogram[(item.Key >> shift) & 0xFF]++] = item;
+			}
+			SortItems.swap(SortScratch);
+		}
+	}
+
+	void VLRenderQueue::Emit(VLCommandStream& Stream, uint32_t FirstDraw, uint32_t DrawCount)
+	{
+		const uint32_t endDraw = static_cast<uint32_t>(std::min<uint64_t>(
+			uint64_t(FirstDraw) + DrawCount, SortItems.size()));
+
+		const VLPipeline* pBoundPipeline = nullptr;
+		const void* pBoundGeometry = nullptr;
+		uint32_t pipelineBinds = 0;
+		uint32_t geometryBinds = 0;
+		for (uint32_t i = FirstDraw; i < endDraw; i++)
+		{
+			const Draw& draw = Draws[SortItems[i].DrawIndex];
+			if (draw.pPipeline != pBoundPipeline)
+			{
+				draw.pPipeline->Bind(Stream);
+				pBoundPipeline = draw.pPipeline;
+				pipelineBinds++;
+			}
+			// Note:	Pooled models share the buffers of their pool, binding one binds them all
+			if (draw.pModel->GetGeometrySource() != pBoundGeometry)
+			{
+				draw.pModel->Bind(Stream);
+				pBoundGeometry = draw.pModel->GetGeometrySource();
+				geometryBinds++;
+			}
+			if (draw.PushSize > 0)
+			{
+				Stream.PushConstants(draw.Layout, draw.PushStages, 0, draw.PushSize, PushData.data() + draw.PushOffset);
+			}
+			draw.pModel->Draw(Stream, draw.InstanceCount, draw.FirstInstance);
+		}
+
+		EmittedDraws += endDraw > FirstDraw ? endDraw - FirstDraw : 0;
+		PipelineBinds += pipelineBinds;
+		GeometryBinds += geometryBinds;
+	}
+
+	VLRenderQueueStatistics VLRenderQueue::GetStatistics() const
+	{
+		VLRenderQueueStatistics statistics{};
+		statistics.DrawCount = EmittedDraws;
+		statistics.PipelineBinds = PipelineBinds;
+		statistics.GeometryBinds = GeometryBinds;
+		statistics.SavedBinds = 2 * statistics.DrawCount - statistics.PipelineBinds - statistics.GeometryBinds;
+		return statistics;
+	}
+}
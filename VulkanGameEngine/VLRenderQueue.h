@@ -0,0 +1,94 @@
+#pragma once
+
+#include "VLModel.h"
+#include "VLPipeline.h"
+
+#include <atomic>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Bind counts of the draws emitted since the last Reset()
+	struct VLRenderQueueStatistics
+	{
+		uint32_t DrawCount = 0;
+		uint32_t PipelineBinds = 0;
+		uint32_t GeometryBinds = 0;
+		// Binds a naive renderer (one pipeline and one geometry bind per draw) would have recorded on top
+		uint32_t SavedBinds = 0;
+	};
+
+	// Collects the draws of a frame, sorts them on a packed 64-bit key and records them with every bind that
+	// repeats the previous one dropped.
+	// Key layout, most significant first:
+	//	pass (4 bits) | pipeline (12 bits) | material (12 bits) | mesh (16 bits) | depth (20 bits)
+	// Note:	The ids in the key only decide the order, which pipeline and model are bound comes from the draw itself.
+	//			Give things that are expensive to switch the lower ids, and invert the depth for back to front passes.
+	class VLRenderQueue
+	{
+	public:
+		VLRenderQueue() = default;
+
+		VLRenderQueue(const VLRenderQueue&) = delete;
+		VLRenderQueue(VLRenderQueue&&) = delete;
+		VLRenderQueue& operator=(const VLRenderQueue&) = delete;
+		VLRenderQueue& operator=(VLRenderQueue&&) = delete;
+
+		static uint64_t MakeSortKey(uint32_t Pass, uint32_t Pipeline, uint32_t Material, uint32_t Mesh, uint32_t Depth);
+		// Quantizes a depth in [0, 1] to the 20 bits of the key
+		static uint32_t QuantizeDepth(float Depth);
+
+		// Starts a new frame, the statistics are cleared as well
+		void Reset();
+		// PushConstants are copied into the queue and pushed right before the draw, Layout may be VK_NULL_HANDLE
+		// when the draw has none
+		void Submit(uint64_t SortKey, VLPipeline& Pipeline, VLModel& Model, VkPipelineLayout Layout = VK_NULL_HANDLE,
+			VkShaderStageFlags PushStages = 0, const void* PushConstants = nullptr, uint32_t PushSize = 0);
+		// Draws InstanceCount instances, reading the per-instance stream bound by the caller from FirstInstance on
+		void SubmitInstanced(uint64_t SortKey, VLPipeline& Pipeline, VLModel& Model, uint32_t InstanceCount,
+			uint32_t FirstInstance = 0);
+		// Radix sorts the submitted draws, call once after the last Submit
+		void Sort();
+
+		// Writes the sorted draws [FirstDraw, FirstDraw + DrawCount) to Stream. Nothing is assumed to be bound at the
+		// start, so slices can be written to separate streams concurrently.
+		// Note:	Identical push constants of consecutive draws are dropped once the stream is replayed
+		void Emit(VLCommandStream& Stream, uint32_t FirstDraw = 0, uint32_t DrawCount = UINT32_MAX);
+
+		uint32_t GetDrawCount() const { return static_cast<uint32_t>(Draws.size()); }
+		VLRenderQueueStatistics GetStatistics() const;
+
+	private:
+		struct SortItem
+		{
+			uint64_t Key;
+			uint32_t DrawIndex;
+		};
+
+		struct Draw
+		{
+			VLPipeline* pPipeline;
+			VLModel* pModel;
+			VkPipelineLayout Layout;
+			VkShaderStageFlags PushStages;
+			uint32_t PushOffset;
+			uint32_t PushSize;
+			uint32_t InstanceCount;
+			uint32_t FirstInstance;
+		};
+
+		void AddDraw(uint64_t SortKey, const Draw& NewDraw);
+
+		std::vector<Draw> Draws;
+		// Push constant data of all draws back to back
+		std::vector<uint8_t> PushData;
+		std::vector<SortItem> SortItems;
+		// Ping-pong target of the radix passes
+		std::vector<SortItem> SortScratch;
+
+		// Note:	Atomic as slices may be emitted from several threads at once
+		std::atomic<uint32_t> EmittedDraws{ 0 };
+		std::atomic<uint32_t> PipelineBinds{ 0 };
+		std::atomic<uint32_t> GeometryBinds{ 0 };
+	};
+}
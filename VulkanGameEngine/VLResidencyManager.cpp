@@ -0,0 +1,140 @@
+#include "VLResidencyManager.h"
+
+// std headers
+#include <algorithm>
+#include <cassert>
+
+namespace VulkanLearn
+{
+	VLResidencyManager::VLResidencyManager(VLDevice& InDevice, float InBudgetFraction) :
+		Device{ InDevice },
+		BudgetFraction{ InBudgetFraction }
+	{
+		Device.SetOutOfMemoryHandler([this](uint32_t HeapIndex, VkDeviceSize Size)
+			{
+				return Evict(HeapIndex, Size);
+			});
+	}
+
+	VLResidencyManager::~VLResidencyManager()
+	{
+		Device.SetOutOfMemoryHandler(nullptr);
+	}
+
+	VLResidencyManager::Handle VLResidencyManager::Register(
+		const VLAllocation& Allocation, std::function<void()> Evict, bool bPinned)
+	{
+		Handle resource;
+		if (!FreeHandles.empty())
+		{
+			resource = FreeHandles.back();
+			FreeHandles.pop_back();
+		}
+		else
+		{
+			resource = static_cast<Handle>(Resources.size());
+			Resources.emplace_back();
+		}
+
+		Resource& entry = Resources[resource];
+		entry.Size = Allocation.Size;
+		entry.HeapIndex = Device.GetMemoryProperties().memoryTypes[Allocation.MemoryTypeIndex].heapIndex;
+		// Note:	The upload of a new resource is consumed by the frame being recorded at the earliest
+		entry.LastUsedFrame = Device.GetCurrentFrameNumber();
+		entry.bPinned = bPinned;
+		entry.Evict = std::move(Evict);
+
+		ResidentBytes[entry.HeapIndex] += entry.Size;
+		return resource;
+	}
+
+	void VLResidencyManager::Unregister(Handle Resource)
+	{
+		assert(Resource < Resources.size() && Resources[Resource].Evict && "Resource is not registered");
+		ResidentBytes[Resources[Resource].HeapIndex] -= Resources[Resource].Size;
+		Resources[Resource] = {};
+		FreeHandles.push_back(Resource);
+	}
+
+	void VLResidencyManager::Touch(Handle Resource)
+	{
+		assert(Resource < Resources.size() && Resources[Resource].Evict && "Resource is not registered");
+		Resources[Resource].LastUsedFrame = Device.GetCurrentFrameNumber();
+	}
+
+	void VLResidencyManager::SetPinned(Handle Resource, bool bPinned)
+	{
+		assert(Resource < Resources.size() && Resources[Resource].Evict && "Resource is not registered");
+		Resources[Resource].bPinned = bPinned;
+	}
+
+	void VLResidencyManager::Update()
+	{
+		const VkPhysicalDeviceMemoryProperties& memoryProperties = Device.GetMemoryProperties();
+		for (uint32_t heapIndex = 0; heapIndex < memoryProperties.memoryHeapCount; heapIndex++)
+		{
+			if (ResidentBytes[heapIndex] == 0)
+			{
+				continue;
+			}
+
+			const VkDeviceSize limit =
+				static_cast<VkDeviceSize>(Device.GetHeapBudget(heapIndex).Budget * static_cast<double>(BudgetFraction));
+			const VkDeviceSize usage = GetHeapUsage(heapIndex);
+			if (usage > limit)
+			{
+				Evict(heapIndex, usage - limit);
+			}
+		}
+	}
+
+	bool VLResidencyManager::Evict(uint32_t HeapIndex, VkDeviceSize Size)
+	{
+		// Note:	Resources of frames still in flight can't be released yet, those are skipped
+		const uint64_t completedFrame = Device.PollCompletedFrameNumber();
+		std::vector<Handle> candidates;
+		for (Handle resource = 0; resource < Resources.size(); resource++)
+		{
+			const Resource& entry = Resources[resource];
+			if (entry.Evict && !entry.bPinned && entry.HeapIndex == HeapIndex && entry.LastUsedFrame <= completedFrame)
+			{
+				candidates.push_back(resource);
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [this](Handle A, Handle B)
+			{
+				return Resources[A].LastUsedFrame < Resources[B].LastUsedFrame;
+			});
+
+		VkDeviceSize releasedBytes = 0;
+		for (Handle resource : candidates)
+		{
+			if (releasedBytes >= Size)
+			{
+				break;
+			}
+
+			// Note:	Release the slot first, the owner may register again from within its evict function
+			Resource& entry = Resources[resource];
+			std::function<void()> evict = std::move(entry.Evict);
+			releasedBytes += entry.Size;
+			ResidentBytes[HeapIndex] -= entry.Size;
+			entry = {};
+			FreeHandles.push_back(resource);
+			evict();
+		}
+
+		EvictedBytes += releasedBytes;
+		return releasedBytes > 0;
+	}
+
+	VkDeviceSize VLResidencyManager::GetHeapUsage(uint32_t HeapIndex)
+	{
+		const VLMemoryAllocator& allocator = Device.GetMemoryAllocator();
+		const VkDeviceSize usage = Device.GetHeapBudget(HeapIndex).Usage;
+		const VkDeviceSize unusedBlockBytes =
+			allocator.GetHeapBlockBytes(HeapIndex) - allocator.GetHeapAllocatedBytes(HeapIndex);
+		return usage > unusedBlockBytes ? usage - unusedBlockBytes : 0;
+	}
+}
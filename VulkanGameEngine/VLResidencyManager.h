@@ -0,0 +1,77 @@
+#pragma once
+
+#include "VLDevice.h"
+
+#include <functional>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Keeps the device memory used by streamed resources under a fraction of the heap budget by evicting the least
+	// recently used ones. Owners register the allocation of a resource together with an evict function that
+	// releases its memory (dropping it, or keeping a host copy to stream it back in later) and touch the resource
+	// every frame that submits it, also when it is only referenced by a command buffer recorded in an earlier frame.
+	// Note:	Only resources the GPU has finished with are evicted (last used frame <= completed frame), so the evict
+	//			function can destroy the resource right away instead of going through the deletion queue.
+	//			The manager also installs itself as the device's out of memory handler, an allocation that doesn't
+	//			fit anymore evicts before giving up.
+	//			Not thread safe, register, touch and stream in from the main thread before recording starts.
+	class VLResidencyManager
+	{
+	public:
+		using Handle = uint32_t;
+		static constexpr Handle InvalidHandle = UINT32_MAX;
+
+		// BudgetFraction:	Part of the heap budget (VK_EXT_memory_budget, or 80% of the heap without it) that
+		//					may be in use before resources get evicted
+		VLResidencyManager(VLDevice& InDevice, float InBudgetFraction = 0.9f);
+		~VLResidencyManager();
+
+		VLResidencyManager(const VLResidencyManager&) = delete;
+		VLResidencyManager(VLResidencyManager&&) = delete;
+		VLResidencyManager& operator=(const VLResidencyManager&) = delete;
+		VLResidencyManager& operator=(VLResidencyManager&&) = delete;
+
+		// The handle becomes invalid once Evict has been called, the owner registers again after streaming back in
+		Handle Register(const VLAllocation& Allocation, std::function<void()> Evict, bool bPinned = false);
+		// Call when the owner destroys the resource itself
+		void Unregister(Handle Resource);
+		// Marks the resource as used by the frame being recorded, it isn't evicted before that frame has completed
+		void Touch(Handle Resource);
+		// Pinned resources are never evicted (e.g. render targets or geometry that is always visible)
+		void SetPinned(Handle Resource, bool bPinned);
+
+		// Call once per frame, evicts from every heap that is over the budget fraction
+		void Update();
+		// Evicts least recently used resources of the heap until at least Size bytes were released,
+		// returns false if nothing could be evicted
+		bool Evict(uint32_t HeapIndex, VkDeviceSize Size);
+
+		void SetBudgetFraction(float InBudgetFraction) { BudgetFraction = InBudgetFraction; }
+		float GetBudgetFraction() const { return BudgetFraction; }
+		VkDeviceSize GetResidentBytes(uint32_t HeapIndex) const { return ResidentBytes[HeapIndex]; }
+		VkDeviceSize GetEvictedBytes() const { return EvictedBytes; }
+
+	private:
+		struct Resource
+		{
+			VkDeviceSize Size = 0;
+			uint32_t HeapIndex = 0;
+			uint64_t LastUsedFrame = 0;
+			bool bPinned = false;
+			std::function<void()> Evict;
+		};
+
+		// Heap usage that can't be reused without evicting: free space in our own blocks is left out
+		VkDeviceSize GetHeapUsage(uint32_t HeapIndex);
+
+		VLDevice& Device;
+		float BudgetFraction;
+
+		// Indexed by handle, evicted slots are reused through the free list
+		std::vector<Resource> Resources;
+		std::vector<Handle> FreeHandles;
+		VkDeviceSize ResidentBytes[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize EvictedBytes = 0;
+	};
+}
@@ -0,0 +1,204 @@
+#include "VLStreamingCopy.h"
+
+#include "VLDevice.h"
+
+// std headers
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VL_STREAMING_COPY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// Note:	MSVC allows AVX intrinsics in any function, GCC and Clang need the target enabled per function
+#define VL_TARGET_AVX
+#else
+#include <cpuid.h>
+#define VL_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+namespace VulkanLearn
+{
+	namespace
+	{
+		// Below this the setup of the streaming loop costs more than it gains
+		constexpr size_t MinStreamingSize = 256;
+
+#ifdef VL_STREAMING_COPY_X86
+		void CpuId(int Leaf, int OutRegisters[4])
+		{
+#ifdef _MSC_VER
+			__cpuid(OutRegisters, Leaf);
+#else
+			unsigned int eax, ebx, ecx, edx;
+			__cpuid(Leaf, eax, ebx, ecx, edx);
+			OutRegisters[0] = static_cast<int>(eax);
+			OutRegisters[1] = static_cast<int>(ebx);
+			OutRegisters[2] = static_cast<int>(ecx);
+			OutRegisters[3] = static_cast<int>(edx);
+#endif
+		}
+
+		uint64_t ReadXcr0()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			unsigned int eax, edx;
+			__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+		}
+
+		VLStreamingCopyPath DetectPath()
+		{
+			int registers[4];
+			CpuId(1, registers);
+			const bool bSSE2 = (registers[3] & (1 << 26)) != 0;
+			const bool bOSXSAVE = (registers[2] & (1 << 27)) != 0;
+			const bool bAVX = (registers[2] & (1 << 28)) != 0;
+
+			// Note:	The CPU having AVX is not enough, the OS must also save the YMM registers on context switches
+			if (bAVX && bOSXSAVE && (ReadXcr0() & 0x6) == 0x6)
+			{
+				return VLStreamingCopyPath::AVX;
+			}
+			return bSSE2 ? VLStreamingCopyPath::SSE2 : VLStreamingCopyPath::Memcpy;
+		}
+
+		// Both copy the aligned middle part, Size is a multiple of the vector width and pDst aligned to it
+		void StreamSSE2(char* pDst, const char* pSrc, size_t Size)
+		{
+			for (size_t i = 0; i < Size; i += 64)
+			{
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 16));
+				const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 32));
+				const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i + 48));
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i), a);
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 16), b);
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 32), c);
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDst + i + 48), d);
+			}
+		}
+
+		VL_TARGET_AVX void StreamAVX(char* pDst, const char* pSrc, size_t Size)
+		{
+			for (size_t i = 0; i < Size; i += 64)
+			{
+				const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i));
+				const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSrc + i + 32));
+				_mm256_stream_si256(reinterpret_cast<__m256i*>(pDst + i), a);
+				_mm256_stream_si256(reinterpret_cast<__m256i*>(pDst + i + 32), b);
+			}
+		}
+#endif
+	}
+
+	VLStreamingCopyPath VLGetStreamingCopyPath()
+	{
+#ifdef VL_STREAMING_COPY_X86
+		static const VLStreamingCopyPath path = DetectPath();
+		return path;
+#else
+		return VLStreamingCopyPath::Memcpy;
+#endif
+	}
+
+	void VLStreamingCopy(void* pDst, const void* pSrc, size_t Size)
+	{
+#ifdef VL_STREAMING_COPY_X86
+		const VLStreamingCopyPath path = VLGetStreamingCopyPath();
+		if (Size >= MinStreamingSize && path != VLStreamingCopyPath::Memcpy)
+		{
+			char* pDstBytes = static_cast<char*>(pDst);
+			const char* pSrcBytes = static_cast<const char*>(pSrc);
+
+			// Note:	Work in whole cache lines, so every line is written completely and the write-combining
+			//			buffers can be sent out without reading anything back. Head and tail go through memcpy.
+			const size_t head = (64 - (reinterpret_cast<uintptr_t>(pDstBytes) & 63)) & 63;
+			const size_t body = (Size - head) & ~static_cast<size_t>(63);
+			memcpy(pDstBytes, pSrcBytes, head);
+			if (path == VLStreamingCopyPath::AVX)
+			{
+				StreamAVX(pDstBytes + head, pSrcBytes + head, body);
+			}
+			else
+			{
+				StreamSSE2(pDstBytes + head, pSrcBytes + head, body);
+			}
+			memcpy(pDstBytes + head + body, pSrcBytes + head + body, Size - head - body);
+
+			// Streaming stores are weakly ordered, make them visible before anything (e.g. a submit) follows
+			_mm_sfence();
+			return;
+		}
+#endif
+		memcpy(pDst, pSrc, Size);
+	}
+
+	std::vector<VLStreamingCopyBenchmarkResult> VLBenchmarkStreamingCopy(
+		VLDevice& Device, VkDeviceSize CopySize, uint32_t Iterations)
+	{
+		std::vector<char> source(static_cast<size_t>(CopySize));
+		for (size_t i = 0; i < source.size(); i++)
+		{
+			source[i] = static_cast<char>(i * 31);
+		}
+
+		std::vector<VLStreamingCopyBenchmarkResult> results;
+		const VkPhysicalDeviceMemoryProperties& memoryProperties = Device.GetMemoryProperties();
+		for (uint32_t typeIndex = 0; typeIndex < memoryProperties.memoryTypeCount; typeIndex++)
+		{
+			const VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[typeIndex].propertyFlags;
+			if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+			{
+				continue;
+			}
+
+			// Note:	Asking for the exact flags of the type may still land in an earlier type with a superset
+			//			of them, those are only measured once
+			VkBuffer buffer;
+			VLAllocation allocation;
+			Device.CreateBuffer(CopySize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, flags, buffer, allocation);
+			const bool bMeasured = std::any_of(results.begin(), results.end(),
+				[&](const VLStreamingCopyBenchmarkResult& Result)
+				{
+					return Result.MemoryTypeIndex == allocation.MemoryTypeIndex;
+				});
+
+			if (!bMeasured && allocation.pMapped != nullptr)
+			{
+				auto measure = [&](auto Copy)
+					{
+						const auto start = std::chrono::high_resolution_clock::now();
+						for (uint32_t i = 0; i < Iterations; i++)
+						{
+							Copy(allocation.pMapped, source.data(), source.size());
+						}
+						const std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+						return static_cast<double>(CopySize) * Iterations / (1024.0 * 1024.0) / seconds.count();
+					};
+
+				VLStreamingCopyBenchmarkResult result{};
+				result.MemoryTypeIndex = allocation.MemoryTypeIndex;
+				result.PropertyFlags = memoryProperties.memoryTypes[allocation.MemoryTypeIndex].propertyFlags;
+				result.MemcpyThroughput = measure([](void* pDst, const void* pSrc, size_t Size)
+					{
+						memcpy(pDst, pSrc, Size);
+					});
+				result.StreamingThroughput = measure(&VLStreamingCopy);
+				results.push_back(result);
+			}
+
+			// Note:	The GPU never saw the buffer, so it is released right away
+			vkDestroyBuffer(Device.GetDevice(), buffer, Device.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+			Device.FreeMemory(allocation);
+		}
+		return results;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace VulkanLearn
+{
+	class VLDevice;
+
+	// memcpy replacement for writes into mapped write-combined memory (uploads, staging, ring buffers).
+	// Uses non-temporal AVX or SSE2 stores when the CPU supports them: those skip the cache and never read the
+	// destination lines back, which plain memcpy may do and which is slow over the bus.
+	// Note:	Don't use it for HOST_CACHED memory that the CPU reads again, the data would not be in the cache
+	void VLStreamingCopy(void* pDst, const void* pSrc, size_t Size);
+
+	// Which path VLStreamingCopy takes on this CPU
+	enum class VLStreamingCopyPath
+	{
+		Memcpy,
+		SSE2,
+		AVX
+	};
+	VLStreamingCopyPath VLGetStreamingCopyPath();
+
+	// Host write throughput into one memory type, in MB/s
+	struct VLStreamingCopyBenchmarkResult
+	{
+		uint32_t MemoryTypeIndex;
+		VkMemoryPropertyFlags PropertyFlags;
+		double MemcpyThroughput;
+		double StreamingThroughput;
+	};
+	// Compares memcpy against VLStreamingCopy into a buffer of every host visible memory type
+	// Note:	Allocates CopySize bytes per memory type, only run it while nothing else needs the memory
+	std::vector<VLStreamingCopyBenchmarkResult> VLBenchmarkStreamingCopy(
+		VLDevice& Device, VkDeviceSize CopySize = 16 * 1024 * 1024, uint32_t Iterations = 16);
+}
@@ -1,4 +1,5 @@
 #include "VLSwapChain.h"
+#include "VLUploadEngine.h"
 
 // std
 #include <array>
@@ -33,49 +34,61 @@ namespace VulkanLearn
 
 	VLSwapChain::~VLSwapChain() 
 	{
-		for (auto imageView : SwapChainImageViews) 
-		{
-			vkDestroyImageView(Device.GetDevice(), imageView, nullptr);
-		}
-		SwapChainImageViews.clear();
-
-		if (SwapChain != nullptr) 
-		{
-			vkDestroySwapchainKHR(Device.GetDevice(), SwapChain, nullptr);
-			SwapChain = nullptr;
-		}
-
-		for (int i = 0; i < DepthImages.size(); i++) 
-		{
-			vkDestroyImageView(Device.GetDevice(), DepthImageViews[i], nullptr);
-			vkDestroyImage(Device.GetDevice(), DepthImages[i], nullptr);
-			vkFreeMemory(Device.GetDevice(), DepthImageMemorys[i], nullptr);
-		}
-
-		for (auto framebuffer : SwapChainFramebuffers) 
-		{
-			vkDestroyFramebuffer(Device.GetDevice(), framebuffer, nullptr);
-		}
-
-		vkDestroyRenderPass(Device.GetDevice(), RenderPass, nullptr);
-
-		// cleanup synchronization objects
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
-		{
-			vkDestroySemaphore(Device.GetDevice(), RenderFinishedSemaphores[i], nullptr);
-			vkDestroySemaphore(Device.GetDevice(), ImageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(Device.GetDevice(), InFlightFences[i], nullptr);
-		}
+		// Note:	Frames in flight may still render to (or present) our images, so everything is destroyed through
+		//			the device's deletion queue instead of waiting for the device to go idle
+		VkDevice device = Device.GetDevice();
+		Device.DeferDestroy(
+			[device,
+			imageViews = std::move(SwapChainImageViews),
+			swapChain = SwapChain,
+			depthImageView = DepthImageView,
+			depthImage = DepthImage,
+			depthImageAllocation = DepthImageAllocation,
+			framebuffers = std::move(SwapChainFramebuffers),
+			renderPass = RenderPass,
+			renderFinishedSemaphores = std::move(RenderFinishedSemaphores),
+			imageAvailableSemaphores = std::move(ImageAvailableSemaphores),
+			inFlightFences = std::move(InFlightFences),
+			pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain),
+			&deviceRef = Device]() mutable
+			{
+				for (auto imageView : imageViews)
+				{
+					vkDestroyImageView(device, imageView, pAllocator);
+				}
+
+				if (swapChain != nullptr)
+				{
+					vkDestroySwapchainKHR(device, swapChain, pAllocator);
+				}
+
+				vkDestroyImageView(device, depthImageView, pAllocator);
+				vkDestroyImage(device, depthImage, deviceRef.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+				deviceRef.FreeMemory(depthImageAllocation);
+
+				for (auto framebuffer : framebuffers)
+				{
+					vkDestroyFramebuffer(device, framebuffer, pAllocator);
+				}
+
+				vkDestroyRenderPass(device, renderPass, pAllocator);
+
+				// cleanup synchronization objects (empty when a newer swap chain took them over)
+				for (size_t i = 0; i < imageAvailableSemaphores.size(); i++)
+				{
+					vkDestroySemaphore(device, renderFinishedSemaphores[i], pAllocator);
+					vkDestroySemaphore(device, imageAvailableSemaphores[i], pAllocator);
+				}
+				for (VkFence fence : inFlightFences)
+				{
+					vkDestroyFence(device, fence, pAllocator);
+				}
+			});
 	}
 
 	VkResult VLSwapChain::AcquireNextImage(uint32_t* ImageIndex) 
 	{
-		vkWaitForFences(
-			Device.GetDevice(),
-			1,
-			&InFlightFences[CurrentFrame],
-			VK_TRUE,
-			std::numeric_limits<uint64_t>::max());
+		WaitForFrame(InFlightFrameNumbers[CurrentFrame]);
 
 		VkResult result = vkAcquireNextImageKHR(
 			Device.GetDevice(),
@@ -85,18 +98,46 @@ namespace VulkanLearn
 			VK_NULL_HANDLE,
 			ImageIndex);
 
+		// Note:	An earlier frame in flight may still be rendering to this image. Waiting here rather than at submit
+		//			means the command buffer of the image is no longer pending once we return, so the caller can
+		//			either re-record it or submit it again as it is.
+		if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+		{
+			WaitForFrame(ImageFrameNumbers[*ImageIndex]);
+		}
 		return result;
 	}
 
-	VkResult VLSwapChain::SubmitCommandBuffers(
-		const VkCommandBuffer* Buffers, uint32_t* ImageIndex) 
+	void VLSwapChain::WaitForFrame(uint64_t FrameNumber)
 	{
-		if (ImagesInFlight[*ImageIndex] != VK_NULL_HANDLE) 
+		// Note:	Most of the time the frame is long done, then no wait or fence call is made at all
+		if (Device.IsFrameComplete(FrameNumber))
 		{
-			vkWaitForFences(Device.GetDevice(), 1, &ImagesInFlight[*ImageIndex], VK_TRUE, UINT64_MAX);
+			Device.CompleteFrame(FrameNumber);
+			return;
+		}
+		if (Device.IsTimelineSemaphoreSupported())
+		{
+			Device.WaitForFrame(FrameNumber);
+			return;
 		}
-		ImagesInFlight[*ImageIndex] = InFlightFences[CurrentFrame];
 
+		// Note:	A slot only takes a new frame after its previous one has completed, so a frame that is not in
+		//			any slot anymore has completed as well
+		for (size_t i = 0; i < InFlightFrameNumbers.size(); i++)
+		{
+			if (InFlightFrameNumbers[i] == FrameNumber)
+			{
+				vkWaitForFences(Device.GetDevice(), 1, &InFlightFences[i], VK_TRUE, UINT64_MAX);
+				break;
+			}
+		}
+		Device.CompleteFrame(FrameNumber);
+	}
+
+	VkResult VLSwapChain::SubmitCommandBuffers(
+		const VkCommandBuffer* Buffers, uint32_t* ImageIndex) 
+	{
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
@@ -109,13 +150,42 @@ namespace VulkanLearn
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = Buffers;
 
-		VkSemaphore signalSemaphores[] = { RenderFinishedSemaphores[CurrentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
+		// Make this frame's host writes to non-coherent memory visible before the GPU reads them
+		Device.FlushMappedMemory();
+		// Uploads recorded while this frame was built (e.g. geometry streamed back in) have to be acquired first
+		Device.GetUploadEngine().Submit();
+		const uint64_t frameNumber = Device.SubmitFrame();
+		InFlightFrameNumbers[CurrentFrame] = frameNumber;
+		ImageFrameNumbers[*ImageIndex] = frameNumber;
+
+		// Note:	With timeline semaphores the submit also signals the frame timeline with the frame number,
+		//			which replaces the fence with its reset and wait round trips. The value of the binary
+		//			semaphores is ignored.
+		VkSemaphore signalSemaphores[] = { RenderFinishedSemaphores[CurrentFrame], Device.GetFrameTimeline() };
+		const uint64_t waitValues[] = { 0 };
+		const uint64_t signalValues[] = { 0, frameNumber };
+		VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.waitSemaphoreValueCount = 1;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		timelineInfo.signalSemaphoreValueCount = 2;
+		timelineInfo.pSignalSemaphoreValues = signalValues;
+
 		submitInfo.pSignalSemaphores = signalSemaphores;
+		VkFence fence = VK_NULL_HANDLE;
+		if (Device.IsTimelineSemaphoreSupported())
+		{
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.signalSemaphoreCount = 2;
+		}
+		else
+		{
+			submitInfo.signalSemaphoreCount = 1;
+			fence = InFlightFences[CurrentFrame];
+			vkResetFences(Device.GetDevice(), 1, &fence);
+		}
 
-		vkResetFences(Device.GetDevice(), 1, &InFlightFences[CurrentFrame]);
-		if (vkQueueSubmit(Device.GetGraphicsQueue(), 1, &submitInfo, InFlightFences[CurrentFrame]) !=
-			VK_SUCCESS) 
+		if (vkQueueSubmit(Device.GetGraphicsQueue(), 1, &submitInfo, fence) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
@@ -215,7 +285,10 @@ namespace VulkanLearn
 		//			For now, assume only one swap chain will be created
 		createInfo.oldSwapchain = OldSwapChain == nullptr ? VK_NULL_HANDLE : OldSwapChain->SwapChain;
 
-		if (vkCreateSwapchainKHR(Device.GetDevice(), &createInfo, nullptr, &SwapChain) != VK_SUCCESS) 
+		// Note:	Temporary driver allocations of the creation go to the arena, the swap chain itself to the heap
+		VLHostAllocator::ScopedArena arena;
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain);
+		if (vkCreateSwapchainKHR(Device.GetDevice(), &createInfo, pAllocator, &SwapChain) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("failed to create swap chain!");
 		}
@@ -255,7 +328,8 @@ namespace VulkanLearn
 			// stereographic 3D applications can use different layers to set a different view for each eye
 			viewInfo.subresourceRange.layerCount = 1;
 
-			if (vkCreateImageView(Device.GetDevice(), &viewInfo, nullptr, &SwapChainImageViews[i]) !=
+			if (vkCreateImageView(Device.GetDevice(), &viewInfo,
+				Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain), &SwapChainImageViews[i]) !=
 				VK_SUCCESS) {
 				throw std::runtime_error("failed to create texture image view!");
 			}
@@ -301,14 +375,19 @@ namespace VulkanLearn
 
 		VkSubpassDependency dependency = {};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.srcAccessMask = 0;
+		// Note:	The depth attachment is shared between frames, so the depth tests and clear of this frame have to
+		//			wait for the depth writes of the previous one (write-after-write on the same image)
+		dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		dependency.srcStageMask =
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependency.dstSubpass = 0;
 		dependency.dstStageMask =
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+			VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependency.dstAccessMask =
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 		std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
 		VkRenderPassCreateInfo renderPassInfo = {};
@@ -320,7 +399,8 @@ namespace VulkanLearn
 		renderPassInfo.dependencyCount = 1;
 		renderPassInfo.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(Device.GetDevice(), &renderPassInfo, nullptr, &RenderPass) != VK_SUCCESS) 
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain);
+		if (vkCreateRenderPass(Device.GetDevice(), &renderPassInfo, pAllocator, &RenderPass) != VK_SUCCESS) 
 		{
 			throw std::runtime_error("failed to create render pass!");
 		}
@@ -329,7 +409,7 @@ namespace VulkanLearn
 	void VLSwapChain::CreateFramebuffers() {
 		SwapChainFramebuffers.resize(GetImageCount());
 		for (size_t i = 0; i < GetImageCount(); i++) {
-			std::array<VkImageView, 2> attachments = { SwapChainImageViews[i], DepthImageViews[i] };
+			std::array<VkImageView, 2> attachments = { SwapChainImageViews[i], DepthImageView };
 
 			VkExtent2D SwapChainExtent = GetSwapChainExtent();
 			VkFramebufferCreateInfo framebufferInfo = {};
@@ -344,7 +424,7 @@ namespace VulkanLearn
 			if (vkCreateFramebuffer(
 				Device.GetDevice(),
 				&framebufferInfo,
-				nullptr,
+				Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain),
 				&SwapChainFramebuffers[i]) != VK_SUCCESS) 
 			{
 				throw std::runtime_error("failed to create framebuffer!");
@@ -357,58 +437,72 @@ namespace VulkanLearn
 		VkFormat depthFormat = FindDepthFormat();
 		VkExtent2D SwapChainExtent = GetSwapChainExtent();
 
-		DepthImages.resize(GetImageCount());
-		DepthImageMemorys.resize(GetImageCount());
-		DepthImageViews.resize(GetImageCount());
-
-		for (int i = 0; i < DepthImages.size(); i++) 
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width = SwapChainExtent.width;
+		imageInfo.extent.height = SwapChainExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = depthFormat;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		// Note:	Depth never leaves the render pass, so tile based GPUs can keep it in on-chip memory entirely
+		//			and only back it with lazily allocated memory. Other GPUs simply ignore the hint.
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.flags = 0;
+
+		Device.CreateImageWithInfo(
+			imageInfo,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			DepthImage,
+			DepthImageAllocation,
+			VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = DepthImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = depthFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain);
+		if (vkCreateImageView(Device.GetDevice(), &viewInfo, pAllocator, &DepthImageView) != VK_SUCCESS) 
 		{
-			VkImageCreateInfo imageInfo{};
-			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			imageInfo.imageType = VK_IMAGE_TYPE_2D;
-			imageInfo.extent.width = SwapChainExtent.width;
-			imageInfo.extent.height = SwapChainExtent.height;
-			imageInfo.extent.depth = 1;
-			imageInfo.mipLevels = 1;
-			imageInfo.arrayLayers = 1;
-			imageInfo.format = depthFormat;
-			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			imageInfo.flags = 0;
-
-			Device.CreateImageWithInfo(
-				imageInfo,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				DepthImages[i],
-				DepthImageMemorys[i]);
-
-			VkImageViewCreateInfo viewInfo{};
-			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			viewInfo.image = DepthImages[i];
-			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			viewInfo.format = depthFormat;
-			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			viewInfo.subresourceRange.baseMipLevel = 0;
-			viewInfo.subresourceRange.levelCount = 1;
-			viewInfo.subresourceRange.baseArrayLayer = 0;
-			viewInfo.subresourceRange.layerCount = 1;
-
-			if (vkCreateImageView(Device.GetDevice(), &viewInfo, nullptr, &DepthImageViews[i]) != VK_SUCCESS) 
-			{
-				throw std::runtime_error("failed to create texture image view!");
-			}
+			throw std::runtime_error("failed to create texture image view!");
 		}
 	}
 
 	void VLSwapChain::CreateSyncObjects()
 	{
+		ImageFrameNumbers.resize(GetImageCount(), 0);
+
+		// Note:	Take over the frame in flight objects of the previous swap chain, its last frames may still be
+		//			running and the next frames have to wait on their fences (and report their completion)
+		if (OldSwapChain != nullptr)
+		{
+			ImageAvailableSemaphores = std::move(OldSwapChain->ImageAvailableSemaphores);
+			RenderFinishedSemaphores = std::move(OldSwapChain->RenderFinishedSemaphores);
+			InFlightFences = std::move(OldSwapChain->InFlightFences);
+			InFlightFrameNumbers = std::move(OldSwapChain->InFlightFrameNumbers);
+			CurrentFrame = OldSwapChain->CurrentFrame;
+			return;
+		}
+
 		ImageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		RenderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		ImagesInFlight.resize(GetImageCount(), VK_NULL_HANDLE);
+		InFlightFrameNumbers.resize(MAX_FRAMES_IN_FLIGHT, 0);
+		if (!Device.IsTimelineSemaphoreSupported())
+		{
+			InFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		}
 
 		VkSemaphoreCreateInfo semaphoreInfo = {};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -417,13 +511,15 @@ namespace VulkanLearn
 		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::SwapChain);
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) 
 		{
-			if (vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, nullptr, &ImageAvailableSemaphores[i]) !=
+			if (vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, pAllocator, &ImageAvailableSemaphores[i]) !=
 				VK_SUCCESS ||
-				vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, nullptr, &RenderFinishedSemaphores[i]) !=
+				vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, pAllocator, &RenderFinishedSemaphores[i]) !=
 				VK_SUCCESS ||
-				vkCreateFence(Device.GetDevice(), &fenceInfo, nullptr, &InFlightFences[i]) != VK_SUCCESS) {
+				(!InFlightFences.empty() &&
+				vkCreateFence(Device.GetDevice(), &fenceInfo, pAllocator, &InFlightFences[i]) != VK_SUCCESS)) {
 				throw std::runtime_error("failed to create synchronization objects for a frame!");
 			}
 		}
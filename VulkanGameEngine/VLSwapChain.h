@@ -35,7 +35,10 @@ namespace VulkanLearn {
             return static_cast<float>(SwapChainExtent.width) / static_cast<float>(SwapChainExtent.height);
         }
         VkFormat FindDepthFormat();
+        // Frame in flight slot the next submit belongs to, its previous frame has completed once AcquireNextImage returns
+        size_t GetCurrentFrame() { return CurrentFrame; }
 
+        // Returns once the previous submit that rendered to the acquired image has completed
         VkResult AcquireNextImage(uint32_t* ImageIndex);
         VkResult SubmitCommandBuffers(const VkCommandBuffer* Buffers, uint32_t* imageIndex);
 
@@ -47,6 +50,8 @@ namespace VulkanLearn {
         void CreateRenderPass();
         void CreateFramebuffers();
         void CreateSyncObjects();
+        // Blocks until the device frame has completed, on the frame timeline or on the fence of its slot
+        void WaitForFrame(uint64_t FrameNumber);
 
         // Helper functions
         VkSurfaceFormatKHR ChooseSwapSurfaceFormat(
@@ -62,9 +67,11 @@ namespace VulkanLearn {
         std::vector<VkFramebuffer> SwapChainFramebuffers;
         VkRenderPass RenderPass;
 
-        std::vector<VkImage> DepthImages;
-        std::vector<VkDeviceMemory> DepthImageMemorys;
-        std::vector<VkImageView> DepthImageViews;
+        // Note:	One depth attachment shared by all framebuffers. Its contents are cleared on load and never
+        //			stored, and the render pass dependency orders the depth accesses of consecutive frames.
+        VkImage DepthImage;
+        VLAllocation DepthImageAllocation;
+        VkImageView DepthImageView;
         std::vector<VkImage> SwapChainImages;
         std::vector<VkImageView> SwapChainImageViews;
 
@@ -80,8 +87,12 @@ namespace VulkanLearn {
 
         std::vector<VkSemaphore> ImageAvailableSemaphores;
         std::vector<VkSemaphore> RenderFinishedSemaphores;
+        // Note:	Empty with timeline semaphores, frames signal the device's frame timeline instead
         std::vector<VkFence> InFlightFences;
-        std::vector<VkFence> ImagesInFlight;
+        // Device frame number submitted in every frame in flight slot
+        std::vector<uint64_t> InFlightFrameNumbers;
+        // Device frame number that rendered to every swap chain image last, 0 when none did yet
+        std::vector<uint64_t> ImageFrameNumbers;
         size_t CurrentFrame = 0;
     };
 
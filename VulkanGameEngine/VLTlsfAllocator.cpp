@@ -0,0 +1,510 @@
+#include "VLTlsfAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace VulkanLearn
+{
+	// Index of the most significant set bit, Value must not be 0
+	static uint32_t FindLastSet(uint64_t Value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, Value);
+		return static_cast<uint32_t>(index);
+#else
+		return 63u - static_cast<uint32_t>(__builtin_clzll(Value));
+#endif
+	}
+
+	// Index of the least significant set bit, Value must not be 0
+	static uint32_t FindFirstSet(uint64_t Value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, Value);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(Value));
+#endif
+	}
+
+	VLTlsfAllocator::VLTlsfAllocator(VkDeviceSize InCapacity) :
+		Capacity{ InCapacity },
+		FreeSize{ InCapacity }
+	{
+		assert(Capacity > 0 && "TLSF allocator needs a non-empty range");
+		for (auto& lists : FreeLists)
+		{
+			std::fill(std::begin(lists), std::end(lists), NullNode);
+		}
+
+		// Start out with one free node spanning the whole range
+		uint32_t node = CreateNode();
+		Nodes[node].Offset = 0;
+		Nodes[node].Size = Capacity;
+		LastPhysical = node;
+		InsertFreeNode(node);
+	}
+
+	VLTlsfAllocator::Handle VLTlsfAllocator::Allocate(VkDeviceSize Size, VkDeviceSize Alignment)
+	{
+		if (Size == 0)
+		{
+			return InvalidHandle;
+		}
+
+		// Note:	Searching for the worst case padding up front guarantees any node we find can be aligned
+		const VkDeviceSize searchSize = Size + (Alignment > 1 ? Alignment - 1 : 0);
+		uint32_t node;
+		if (!FindFreeNode(searchSize, node))
+		{
+			return InvalidHandle;
+		}
+		RemoveFreeNode(node);
+
+		const VkDeviceSize alignedOffset = (Nodes[node].Offset + Alignment - 1) / Alignment * Alignment;
+		const VkDeviceSize padding = alignedOffset - Nodes[node].Offset;
+		if (padding > 0)
+		{
+			// Give the padding in front back as its own free node
+			SplitNode(node, padding);
+			uint32_t alignedNode = Nodes[node].NextPhysical;
+			RemoveFreeNode(alignedNode);
+			InsertFreeNode(node);
+			node = alignedNode;
+		}
+
+		if (Nodes[node].Size > Size)
+		{
+			SplitNode(node, Size);
+		}
+
+		Nodes[node].UserData = 0;
+		Nodes[node].Alignment = Alignment;
+		FreeSize -= Nodes[node].Size;
+		AllocationCount++;
+		return node;
+	}
+
+	void VLTlsfAllocator::Free(Handle Allocation)
+	{
+		assert(Allocation < Nodes.size() && !Nodes[Allocation].bFree && "Freeing an invalid TLSF allocation");
+		uint32_t node = Allocation;
+		FreeSize += Nodes[node].Size;
+		AllocationCount--;
+
+		// Merge with the physical neighbours that are free, so the free ranges never become adjacent
+		uint32_t next = Nodes[node].NextPhysical;
+		if (next != NullNode && Nodes[next].bFree)
+		{
+			RemoveFreeNode(next);
+			Nodes[node].Size += Nodes[next].Size;
+			ReleaseNode(next);
+		}
+
+		uint32_t previous = Nodes[node].PreviousPhysical;
+		if (previous != NullNode && Nodes[previous].bFree)
+		{
+			RemoveFreeNode(previous);
+			Nodes[previous].Size += Nodes[node].Size;
+			ReleaseNode(node);
+			node = previous;
+		}
+
+		InsertFreeNode(node);
+	}
+
+	VLTlsfAllocator::Handle VLTlsfAllocator::GetLastAllocation() const
+	{
+		uint32_t node = LastPhysical;
+		while (node != NullNode && Nodes[node].bFree)
+		{
+			node = Nodes[node].PreviousPhysical;
+		}
+		return node == NullNode ? InvalidHandle : node;
+	}
+
+	VLTlsfAllocator::Handle VLTlsfAllocator::GetPreviousAllocation(Handle Allocation) const
+	{
+		uint32_t node = Nodes[Allocation].PreviousPhysical;
+		while (node != NullNode && Nodes[node].bFree)
+		{
+			node = Nodes[node].PreviousPhysical;
+		}
+		return node == NullNode ? InvalidHandle : node;
+	}
+
+	VkDeviceSize VLTlsfAllocator::GetLargestFreeRange() const
+	{
+		if (FirstLevelBitmap == 0)
+		{
+			return 0;
+		}
+
+		// The largest range lives in the highest non-empty bin, only that bin needs to be scanned
+		const uint32_t firstLevel = FindLastSet(FirstLevelBitmap);
+		const uint32_t secondLevel = FindLastSet(SecondLevelBitmaps[firstLevel]);
+		VkDeviceSize largest = 0;
+		for (uint32_t node = FreeLists[firstLevel][secondLevel]; node != NullNode; node = Nodes[node].NextFree)
+		{
+			largest = std::max(largest, Nodes[node].Size);
+		}
+		return largest;
+	}
+
+	float VLTlsfAllocator::GetFragmentation() const
+	{
+		if (FreeSize == 0)
+		{
+			return 0.0f;
+		}
+		return 1.0f - static_cast<float>(GetLargestFreeRange()) / static_cast<float>(FreeSize);
+	}
+
+	void VLTlsfAllocator::MapSize(VkDeviceSize Size, uint32_t& OutFirstLevel, uint32_t& OutSecondLevel)
+	{
+		// Note:	Sizes below SecondLevelCount are binned linearly in the first level,
+		//			above that every power of two is split in SecondLevelCount equally sized sub-classes
+		if (Size < SecondLevelCount)
+		{
+			OutFirstLevel = 0;
+			OutSecondLevel = static_cast<uint32_t>(Size);
+			return;
+		}
+
+		const uint32_t lastSet = FindLastSet(Size);
+		OutFirstLevel = lastSet - SecondLevelBits + 1;
+		OutSecondLevel = static_cast<uint32_t>(Size >> (lastSet - SecondLevelBits)) - SecondLevelCount;
+	}
+
+	bool VLTlsfAllocator::FindFreeNode(VkDeviceSize Size, uint32_t& OutNode) const
+	{
+		uint32_t firstLevel, secondLevel;
+
+		// Round the request up to the next sub-class boundary: every node in that bin or above is large enough
+		VkDeviceSize roundedSize = Size;
+		if (Size >= SecondLevelCount)
+		{
+			const VkDeviceSize granularity = VkDeviceSize{ 1 } << (FindLastSet(Size) - SecondLevelBits);
+			roundedSize = Size + granularity - 1;
+		}
+		MapSize(roundedSize, firstLevel, secondLevel);
+
+		uint32_t secondLevelMap = secondLevel < SecondLevelCount ? SecondLevelBitmaps[firstLevel] & (~0u << secondLevel) : 0;
+		if (secondLevelMap == 0)
+		{
+			const uint64_t firstLevelMap = firstLevel + 1 < 64 ? FirstLevelBitmap & (~uint64_t{ 0 } << (firstLevel + 1)) : 0;
+			if (firstLevelMap != 0)
+			{
+				firstLevel = FindFirstSet(firstLevelMap);
+				secondLevelMap = SecondLevelBitmaps[firstLevel];
+			}
+		}
+
+		if (secondLevelMap != 0)
+		{
+			OutNode = FreeLists[firstLevel][FindFirstSet(secondLevelMap)];
+			return true;
+		}
+
+		// Note:	Nothing is guaranteed to fit, but the exact bin of the request can still hold a large enough node
+		MapSize(Size, firstLevel, secondLevel);
+		for (uint32_t node = FreeLists[firstLevel][secondLevel]; node != NullNode; node = Nodes[node].NextFree)
+		{
+			if (Nodes[node].Size >= Size)
+			{
+				OutNode = node;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void VLTlsfAllocator::InsertFreeNode(uint32_t NodeIndex)
+	{
+		uint32_t firstLevel, secondLevel;
+		MapSize(Nodes[NodeIndex].Size, firstLevel, secondLevel);
+
+		uint32_t& head = FreeLists[firstLevel][secondLevel];
+		Nodes[NodeIndex].bFree = true;
+		Nodes[NodeIndex].PreviousFree = NullNode;
+		Nodes[NodeIndex].NextFree = head;
+		if (head != NullNode)
+		{
+			Nodes[head].PreviousFree = NodeIndex;
+		}
+		head = NodeIndex;
+
+		FirstLevelBitmap |= uint64_t{ 1 } << firstLevel;
+		SecondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+	}
+
+	void VLTlsfAllocator::RemoveFreeNode(uint32_t NodeIndex)
+	{
+		uint32_t firstLevel, secondLevel;
+		MapSize(Nodes[NodeIndex].Size, firstLevel, secondLevel);
+
+		Node& node = Nodes[NodeIndex];
+		if (node.PreviousFree != NullNode)
+		{
+			Nodes[node.PreviousFree].NextFree = node.NextFree;
+		}
+		else
+		{
+			FreeLists[firstLevel][secondLevel] = node.NextFree;
+		}
+		if (node.NextFree != NullNode)
+		{
+			Nodes[node.NextFree].PreviousFree = node.PreviousFree;
+		}
+		node.bFree = false;
+		node.PreviousFree = NullNode;
+		node.NextFree = NullNode;
+
+		if (FreeLists[firstLevel][secondLevel] == NullNode)
+		{
+			SecondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+			if (SecondLevelBitmaps[firstLevel] == 0)
+			{
+				FirstLevelBitmap &= ~(uint64_t{ 1 } << firstLevel);
+			}
+		}
+	}
+
+	uint32_t VLTlsfAllocator::CreateNode()
+	{
+		if (!UnusedNodes.empty())
+		{
+			uint32_t node = UnusedNodes.back();
+			UnusedNodes.pop_back();
+			Nodes[node] = Node{};
+			return node;
+		}
+		Nodes.emplace_back();
+		return static_cast<uint32_t>(Nodes.size() - 1);
+	}
+
+	void VLTlsfAllocator::ReleaseNode(uint32_t NodeIndex)
+	{
+		// Unlink from the physical list
+		Node& node = Nodes[NodeIndex];
+		if (node.PreviousPhysical != NullNode)
+		{
+			Nodes[node.PreviousPhysical].NextPhysical = node.NextPhysical;
+		}
+		if (node.NextPhysical != NullNode)
+		{
+			Nodes[node.NextPhysical].PreviousPhysical = node.PreviousPhysical;
+		}
+		else
+		{
+			LastPhysical = node.PreviousPhysical;
+		}
+		UnusedNodes.push_back(NodeIndex);
+	}
+
+	void VLTlsfAllocator::SplitNode(uint32_t NodeIndex, VkDeviceSize SplitSize)
+	{
+		assert(SplitSize < Nodes[NodeIndex].Size && "Split must leave a non-empty tail");
+
+		// Note:	CreateNode may reallocate Nodes, so don't hold references across it
+		uint32_t tail = CreateNode();
+		Nodes[tail].Offset = Nodes[NodeIndex].Offset + SplitSize;
+		Nodes[tail].Size = Nodes[NodeIndex].Size - SplitSize;
+		Nodes[tail].PreviousPhysical = NodeIndex;
+		Nodes[tail].NextPhysical = Nodes[NodeIndex].NextPhysical;
+		if (Nodes[tail].NextPhysical != NullNode)
+		{
+			Nodes[Nodes[tail].NextPhysical].PreviousPhysical = tail;
+		}
+		else
+		{
+			LastPhysical = tail;
+		}
+
+		Nodes[NodeIndex].NextPhysical = tail;
+		Nodes[NodeIndex].Size = SplitSize;
+		InsertFreeNode(tail);
+	}
+
+	VLTlsfBufferPool::VLTlsfBufferPool(VLDevice& InDevice, VkDeviceSize InCapacity, VkDeviceSize InUnitSize,
+		VkBufferUsageFlags Usage) :
+		Device{ InDevice },
+		UnitSize{ InUnitSize },
+		Tlsf{ InCapacity }
+	{
+		// Note:	The defragmenter copies within the buffer itself, so it is both transfer source and destination.
+		//			New ranges are uploaded on the transfer queue while the graphics queue reads the others, so the
+		//			buffer is shared between both families instead of changing owner for every upload.
+		Device.CreateBuffer(
+			InCapacity * UnitSize,
+			Usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Buffer,
+			BufferAllocation,
+			0,
+			true);
+	}
+
+	VLTlsfBufferPool::~VLTlsfBufferPool()
+	{
+		Device.DeferDestroyBuffer(Buffer, BufferAllocation);
+	}
+
+	VLTlsfBufferPool::Handle VLTlsfBufferPool::Allocate(VkDeviceSize Count, VkDeviceSize Alignment)
+	{
+		ReleaseRetiredNodes();
+
+		VLTlsfAllocator::Handle node = Tlsf.Allocate(Count, Alignment);
+		if (node == VLTlsfAllocator::InvalidHandle)
+		{
+			return InvalidHandle;
+		}
+
+		Handle handle;
+		if (!FreeHandles.empty())
+		{
+			handle = FreeHandles.back();
+			FreeHandles.pop_back();
+			HandleNodes[handle] = node;
+		}
+		else
+		{
+			handle = static_cast<Handle>(HandleNodes.size());
+			HandleNodes.push_back(node);
+			HandleMovedPasses.push_back(0);
+		}
+		Tlsf.SetUserData(node, handle);
+		return handle;
+	}
+
+	void VLTlsfBufferPool::Free(Handle Allocation)
+	{
+		RetireNode(HandleNodes[Allocation]);
+		HandleNodes[Allocation] = VLTlsfAllocator::InvalidHandle;
+		FreeHandles.push_back(Allocation);
+	}
+
+	void VLTlsfBufferPool::RetireNode(VLTlsfAllocator::Handle Node)
+	{
+		// Note:	Retired nodes are recognized by their cleared user data, the defragmenter steps over them
+		Tlsf.SetUserData(Node, InvalidHandle);
+		RetiredNodes.push_back({ Device.GetCurrentFrameNumber(), Node });
+	}
+
+	void VLTlsfBufferPool::ReleaseRetiredNodes()
+	{
+		const uint64_t completedFrame = Device.PollCompletedFrameNumber();
+		while (!RetiredNodes.empty() && RetiredNodes.front().FrameNumber <= completedFrame)
+		{
+			Tlsf.Free(RetiredNodes.front().Node);
+			RetiredNodes.pop_front();
+		}
+	}
+
+	VkDeviceSize VLTlsfBufferPool::Defragment(VkCommandBuffer CommandBuffer, VkDeviceSize MaxBytes)
+	{
+		// Release what the GPU is done with first, that is the free space we compact into
+		ReleaseRetiredNodes();
+
+		std::vector<VkBufferCopy> copyRegions;
+		std::vector<Handle> movedHandles;
+		VkDeviceSize movedBytes = 0;
+		DefragmentPass++;
+
+		VLTlsfAllocator::Handle node = Tlsf.GetLastAllocation();
+		while (node != VLTlsfAllocator::InvalidHandle)
+		{
+			const VLTlsfAllocator::Handle previous = Tlsf.GetPreviousAllocation(node);
+			const Handle handle = Tlsf.GetUserData(node);
+
+			// Note:	Retired ranges (freed, or the source of an earlier move) may still be read, step over them.
+			//			A destination of this pass is only written by the copy below, moving it again would make
+			//			the regions of the copy overlap.
+			//			Allocations that don't fit the remaining budget or any lower free range are skipped, a smaller
+			//			one further down may still move.
+			if (handle != InvalidHandle && HandleMovedPasses[handle] != DefragmentPass)
+			{
+				const VkDeviceSize size = Tlsf.GetSize(node);
+				if (movedBytes + size * UnitSize > MaxBytes)
+				{
+					node = previous;
+					continue;
+				}
+
+				// Only move the allocation if it ends up closer to the start, keeping the alignment it asked for
+				const VLTlsfAllocator::Handle target = Tlsf.Allocate(size, Tlsf.GetAlignment(node));
+				if (target == VLTlsfAllocator::InvalidHandle || Tlsf.GetOffset(target) > Tlsf.GetOffset(node))
+				{
+					if (target != VLTlsfAllocator::InvalidHandle)
+					{
+						Tlsf.Free(target);
+					}
+					node = previous;
+					continue;
+				}
+
+				VkBufferCopy region{};
+				region.srcOffset = Tlsf.GetOffset(node) * UnitSize;
+				region.dstOffset = Tlsf.GetOffset(target) * UnitSize;
+				region.size = size * UnitSize;
+				copyRegions.push_back(region);
+
+				Tlsf.SetUserData(target, handle);
+				HandleNodes[handle] = target;
+				HandleMovedPasses[handle] = DefragmentPass;
+				RetireNode(node);
+				movedHandles.push_back(handle);
+				movedBytes += region.size;
+			}
+			node = previous;
+		}
+
+		if (copyRegions.empty())
+		{
+			return 0;
+		}
+
+		// Note:	The destination ranges may have been freed while earlier frames still read them, and earlier
+		//			uploads may still be writing the sources. Then make the copies visible to everything after.
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkCmdCopyBuffer(CommandBuffer, Buffer, Buffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(CommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		if (OnAllocationMoved)
+		{
+			for (Handle handle : movedHandles)
+			{
+				OnAllocationMoved(handle);
+			}
+		}
+		return movedBytes;
+	}
+
+	VLTlsfBufferPool::Statistics VLTlsfBufferPool::GetStatistics() const
+	{
+		Statistics statistics{};
+		statistics.Capacity = Tlsf.GetCapacity() * UnitSize;
+		statistics.UsedSize = (Tlsf.GetCapacity() - Tlsf.GetFreeSize()) * UnitSize;
+		statistics.LargestFreeRange = Tlsf.GetLargestFreeRange() * UnitSize;
+		statistics.AllocationCount = Tlsf.GetAllocationCount();
+		statistics.Fragmentation = Tlsf.GetFragmentation();
+		return statistics;
+	}
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "VLDevice.h"
+
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Two-level segregated fit (TLSF) allocator over an abstract range [0, Capacity).
+	// Allocation and free are O(1): free ranges are binned by size class (power of two, split into 16 linear
+	// sub-classes) and two bitmaps find the first non-empty bin that is guaranteed to fit.
+	// Note:	The allocator only does the bookkeeping of offsets, what a unit means (bytes, vertices, ...)
+	//			is up to the owner. Reference: http://www.gii.upv.es/tlsf/files/ecrts04_tlsf.pdf
+	class VLTlsfAllocator
+	{
+	public:
+		using Handle = uint32_t;
+		static constexpr Handle InvalidHandle = ~0u;
+
+		explicit VLTlsfAllocator(VkDeviceSize InCapacity);
+
+		// Returns InvalidHandle when no free range can hold Size units at the given alignment
+		Handle Allocate(VkDeviceSize Size, VkDeviceSize Alignment = 1);
+		void Free(Handle Allocation);
+
+		VkDeviceSize GetOffset(Handle Allocation) const { return Nodes[Allocation].Offset; }
+		VkDeviceSize GetSize(Handle Allocation) const { return Nodes[Allocation].Size; }
+		// Alignment the allocation was made with, to keep it when the range is moved
+		VkDeviceSize GetAlignment(Handle Allocation) const { return Nodes[Allocation].Alignment; }
+		// Free slot for the owner to link an allocation back to its own bookkeeping
+		uint32_t GetUserData(Handle Allocation) const { return Nodes[Allocation].UserData; }
+		void SetUserData(Handle Allocation, uint32_t UserData) { Nodes[Allocation].UserData = UserData; }
+
+		// Walk the allocations from the end of the range towards the start (used for compaction)
+		Handle GetLastAllocation() const;
+		Handle GetPreviousAllocation(Handle Allocation) const;
+
+		VkDeviceSize GetCapacity() const { return Capacity; }
+		VkDeviceSize GetFreeSize() const { return FreeSize; }
+		uint32_t GetAllocationCount() const { return AllocationCount; }
+		VkDeviceSize GetLargestFreeRange() const;
+		// 0 when all free space is one contiguous range, approaching 1 as it gets scattered in small holes
+		float GetFragmentation() const;
+
+	private:
+		static constexpr uint32_t SecondLevelBits = 4;
+		static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+		static constexpr uint32_t FirstLevelCount = 64 - SecondLevelBits + 1;
+		static constexpr uint32_t NullNode = ~0u;
+
+		struct Node
+		{
+			VkDeviceSize Offset = 0;
+			VkDeviceSize Size = 0;
+			VkDeviceSize Alignment = 1;
+			uint32_t PreviousPhysical = NullNode;
+			uint32_t NextPhysical = NullNode;
+			uint32_t PreviousFree = NullNode;
+			uint32_t NextFree = NullNode;
+			uint32_t UserData = 0;
+			bool bFree = false;
+		};
+
+		static void MapSize(VkDeviceSize Size, uint32_t& OutFirstLevel, uint32_t& OutSecondLevel);
+		bool FindFreeNode(VkDeviceSize Size, uint32_t& OutNode) const;
+		void InsertFreeNode(uint32_t NodeIndex);
+		void RemoveFreeNode(uint32_t NodeIndex);
+		uint32_t CreateNode();
+		void ReleaseNode(uint32_t NodeIndex);
+		// Splits the tail of a node of into a new free node, starting SplitSize units in
+		void SplitNode(uint32_t NodeIndex, VkDeviceSize SplitSize);
+
+		VkDeviceSize Capacity;
+		VkDeviceSize FreeSize;
+		uint32_t AllocationCount = 0;
+		uint32_t LastPhysical = NullNode;
+
+		std::vector<Node> Nodes;
+		std::vector<uint32_t> UnusedNodes;
+
+		uint64_t FirstLevelBitmap = 0;
+		uint32_t SecondLevelBitmaps[FirstLevelCount] = {};
+		uint32_t FreeLists[FirstLevelCount][SecondLevelCount];
+	};
+
+	// A single device local buffer that long lived resources (streamed meshes, ...) are sub-allocated from
+	// through a VLTlsfAllocator, with an incremental defragmenter that compacts the buffer using GPU copies.
+	// Note:	Handles stay valid while their data moves, always fetch the offset when recording.
+	class VLTlsfBufferPool
+	{
+	public:
+		using Handle = uint32_t;
+		static constexpr Handle InvalidHandle = ~0u;
+
+		struct Statistics
+		{
+			VkDeviceSize Capacity;
+			VkDeviceSize UsedSize;
+			VkDeviceSize LargestFreeRange;
+			uint32_t AllocationCount;
+			float Fragmentation;
+		};
+
+		// Capacity and all offsets/counts are expressed in units of UnitSize bytes
+		VLTlsfBufferPool(VLDevice& InDevice, VkDeviceSize InCapacity, VkDeviceSize InUnitSize, VkBufferUsageFlags Usage);
+		~VLTlsfBufferPool();
+
+		VLTlsfBufferPool(const VLTlsfBufferPool&) = delete;
+		VLTlsfBufferPool(VLTlsfBufferPool&&) = delete;
+		VLTlsfBufferPool& operator=(const VLTlsfBufferPool&) = delete;
+		VLTlsfBufferPool& operator=(VLTlsfBufferPool&&) = delete;
+
+		// Returns InvalidHandle when the pool is full
+		Handle Allocate(VkDeviceSize Count, VkDeviceSize Alignment = 1);
+		// The handle can be reused right away, the range itself is only handed out again once the frames that
+		// may still read it have completed
+		void Free(Handle Allocation);
+
+		VkDeviceSize GetOffset(Handle Allocation) const { return Tlsf.GetOffset(HandleNodes[Allocation]); }
+		VkDeviceSize GetByteOffset(Handle Allocation) const { return GetOffset(Allocation) * UnitSize; }
+		VkDeviceSize GetCount(Handle Allocation) const { return Tlsf.GetSize(HandleNodes[Allocation]); }
+		VkBuffer GetBuffer() const { return Buffer; }
+		VkDeviceSize GetUnitSize() const { return UnitSize; }
+
+		// Moves up to MaxBytes of allocations from the end of the buffer into free space closer to the start.
+		// Must be recorded outside of a render pass into the command buffer of the current frame, the source
+		// ranges are released once that frame has completed.
+		// Returns the number of bytes scheduled for copying.
+		VkDeviceSize Defragment(VkCommandBuffer CommandBuffer, VkDeviceSize MaxBytes);
+
+		Statistics GetStatistics() const;
+
+		// Called for every allocation whose offset changed during Defragment (e.g. to re-record command buffers)
+		std::function<void(Handle)> OnAllocationMoved;
+
+	private:
+		// Keeps the node allocated until the GPU has completed the current frame
+		void RetireNode(VLTlsfAllocator::Handle Node);
+		void ReleaseRetiredNodes();
+
+		VLDevice& Device;
+		VkBuffer Buffer;
+		VLAllocation BufferAllocation;
+		VkDeviceSize UnitSize;
+
+		VLTlsfAllocator Tlsf;
+		// Maps our stable handles onto the current allocator node
+		std::vector<VLTlsfAllocator::Handle> HandleNodes;
+		// Defragment pass that last moved the allocation of a handle, a range is moved at most once per pass
+		std::vector<uint64_t> HandleMovedPasses;
+		uint64_t DefragmentPass = 0;
+		std::vector<Handle> FreeHandles;
+		struct RetiredNode
+		{
+			uint64_t FrameNumber;
+			VLTlsfAllocator::Handle Node;
+		};
+		// Freed ranges and sources of moves that the GPU may still be reading, in frame order
+		std::deque<RetiredNode> RetiredNodes;
+	};
+}
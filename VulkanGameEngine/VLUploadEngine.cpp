@@ -0,0 +1,446 @@
+#include "VLUploadEngine.h"
+#include "VLStreamingCopy.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace VulkanLearn
+{
+	VLUploadEngine::VLUploadEngine(VLDevice& InDevice) :
+		Device{ InDevice }
+	{
+		QueueFamilyIndices indices = Device.FindPhysicalQueueFamilies();
+		GraphicsFamily = indices.GraphicsFamily.value();
+		TransferFamily = indices.TransferFamily.value_or(GraphicsFamily);
+		bDedicatedQueue = TransferFamily != GraphicsFamily;
+		TransferQueue = bDedicatedQueue ? Device.GetTransferQueue() : Device.GetGraphicsQueue();
+
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = TransferFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(Device.GetDevice(), &poolInfo, pAllocator, &TransferCommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create transfer command pool!");
+		}
+
+		if (bDedicatedQueue)
+		{
+			poolInfo.queueFamilyIndex = GraphicsFamily;
+			if (vkCreateCommandPool(Device.GetDevice(), &poolInfo, pAllocator, &AcquireCommandPool) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create ownership acquire command pool!");
+			}
+		}
+	}
+
+	VLUploadEngine::~VLUploadEngine()
+	{
+		WaitIdle();
+
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		if (bRecording)
+		{
+			FreeSubmissions.push_back(std::move(PendingSubmission));
+		}
+		for (Submission& submission : FreeSubmissions)
+		{
+			for (StagingChunk& chunk : submission.StagingChunks)
+			{
+				DestroyStagingChunk(chunk);
+			}
+			vkDestroySemaphore(Device.GetDevice(), submission.TransferFinishedSemaphore, pAllocator);
+			vkDestroyFence(Device.GetDevice(), submission.Fence, pAllocator);
+		}
+		for (StagingChunk& chunk : FreeStagingChunks)
+		{
+			DestroyStagingChunk(chunk);
+		}
+
+		// Note:	Destroying the pools frees all command buffers allocated from them
+		vkDestroyCommandPool(Device.GetDevice(), TransferCommandPool, pAllocator);
+		if (AcquireCommandPool != VK_NULL_HANDLE)
+		{
+			vkDestroyCommandPool(Device.GetDevice(), AcquireCommandPool, pAllocator);
+		}
+	}
+
+	VLUploadTicket VLUploadEngine::CopyBuffer(VkBuffer SrcBuffer, VkBuffer DstBuffer, VkDeviceSize Size,
+		VkDeviceSize SrcOffset, VkDeviceSize DstOffset, bool bConcurrentDst)
+	{
+		Submission& submission = GetPendingSubmission();
+
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = SrcOffset;
+		copyRegion.dstOffset = DstOffset;
+		copyRegion.size = Size;
+		vkCmdCopyBuffer(submission.TransferCommandBuffer, SrcBuffer, DstBuffer, 1, &copyRegion);
+
+		// Note:	The same barrier is recorded twice, as release on the transfer queue and acquire on the graphics
+		//			queue. The access masks that don't apply to a queue are ignored there.
+		//			A concurrent destination has no owner to transfer, the semaphore orders the queues on its own.
+		const bool bTransferOwnership = bDedicatedQueue && !bConcurrentDst;
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		barrier.srcQueueFamilyIndex = bTransferOwnership ? TransferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = bTransferOwnership ? GraphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = DstBuffer;
+		barrier.offset = DstOffset;
+		barrier.size = Size;
+		PendingBufferTransfers.push_back(barrier);
+
+		return { submission.TicketValue };
+	}
+
+	VLUploadTicket VLUploadEngine::CopyBufferToImage(VkBuffer SrcBuffer, VkImage DstImage, uint32_t Width,
+		uint32_t Height, uint32_t LayerCount, VkImageLayout FinalLayout, VkDeviceSize SrcOffset)
+	{
+		Submission& submission = GetPendingSubmission();
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = DstImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = LayerCount;
+		vkCmdPipelineBarrier(submission.TransferCommandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = SrcOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = LayerCount;
+
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { Width, Height, 1 };
+
+		vkCmdCopyBufferToImage(
+			submission.TransferCommandBuffer,
+			SrcBuffer,
+			DstImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&region);
+
+		// Note:	The layout transition is part of the ownership transfer and has to match on both queues
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = FinalLayout;
+		barrier.srcQueueFamilyIndex = bDedicatedQueue ? TransferFamily : VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = bDedicatedQueue ? GraphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+		PendingImageTransfers.push_back(barrier);
+
+		return { submission.TicketValue };
+	}
+
+	VLUploadTicket VLUploadEngine::UploadToBuffer(const void* Data, VkDeviceSize Size, VkBuffer DstBuffer,
+		VkDeviceSize DstOffset, bool bConcurrentDst)
+	{
+		VkBuffer stagingBuffer;
+		void* pStagingData;
+		const VkDeviceSize stagingOffset = AllocateStaging(Size, stagingBuffer, pStagingData);
+		VLStreamingCopy(pStagingData, Data, static_cast<size_t>(Size));
+		return CopyBuffer(stagingBuffer, DstBuffer, Size, stagingOffset, DstOffset, bConcurrentDst);
+	}
+
+	VLUploadTicket VLUploadEngine::UploadToImage(const void* Data, VkDeviceSize Size, VkImage DstImage,
+		uint32_t Width, uint32_t Height, uint32_t LayerCount, VkImageLayout FinalLayout)
+	{
+		VkBuffer stagingBuffer;
+		void* pStagingData;
+		const VkDeviceSize stagingOffset = AllocateStaging(Size, stagingBuffer, pStagingData);
+		VLStreamingCopy(pStagingData, Data, static_cast<size_t>(Size));
+		return CopyBufferToImage(stagingBuffer, DstImage, Width, Height, LayerCount, FinalLayout, stagingOffset);
+	}
+
+	VLUploadTicket VLUploadEngine::Submit()
+	{
+		if (!bRecording)
+		{
+			// Nothing pending, the last submitted batch is the one to wait for
+			return { NextTicketValue - 1 };
+		}
+
+		Submission submission = std::move(PendingSubmission);
+		bRecording = false;
+
+		const uint32_t bufferBarrierCount = static_cast<uint32_t>(PendingBufferTransfers.size());
+		const uint32_t imageBarrierCount = static_cast<uint32_t>(PendingImageTransfers.size());
+
+		// Release the destinations (or, on a shared queue, simply make the copies visible)
+		vkCmdPipelineBarrier(submission.TransferCommandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			bDedicatedQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 0, nullptr, bufferBarrierCount, PendingBufferTransfers.data(), imageBarrierCount,
+			PendingImageTransfers.data());
+
+		if (vkEndCommandBuffer(submission.TransferCommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record transfer command buffer!");
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &submission.TransferCommandBuffer;
+
+		if (!bDedicatedQueue)
+		{
+			if (vkQueueSubmit(TransferQueue, 1, &submitInfo, submission.Fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit transfer command buffer!");
+			}
+		}
+		else
+		{
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &submission.TransferFinishedSemaphore;
+			if (vkQueueSubmit(TransferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit transfer command buffer!");
+			}
+
+			// Acquire the destinations on the graphics queue as soon as the transfer queue is done with them
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(submission.AcquireCommandBuffer, &beginInfo);
+			// Note:	The source stage matches the semaphore wait stage. Barriers of concurrent destinations are plain
+			//			memory barriers here, their TRANSFER_WRITE source access needs a stage that supports it.
+			vkCmdPipelineBarrier(submission.AcquireCommandBuffer,
+				VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0, 0, nullptr, bufferBarrierCount, PendingBufferTransfers.data(), imageBarrierCount,
+				PendingImageTransfers.data());
+			if (vkEndCommandBuffer(submission.AcquireCommandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to record ownership acquire command buffer!");
+			}
+
+			VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			VkSubmitInfo acquireInfo{};
+			acquireInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			acquireInfo.waitSemaphoreCount = 1;
+			acquireInfo.pWaitSemaphores = &submission.TransferFinishedSemaphore;
+			acquireInfo.pWaitDstStageMask = &waitStage;
+			acquireInfo.commandBufferCount = 1;
+			acquireInfo.pCommandBuffers = &submission.AcquireCommandBuffer;
+			if (vkQueueSubmit(Device.GetGraphicsQueue(), 1, &acquireInfo, submission.Fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit ownership acquire command buffer!");
+			}
+		}
+
+		PendingBufferTransfers.clear();
+		PendingImageTransfers.clear();
+		InFlightSubmissions.push_back(std::move(submission));
+		PendingSubmission = Submission{};
+		return { InFlightSubmissions.back().TicketValue };
+	}
+
+	bool VLUploadEngine::IsComplete(VLUploadTicket Ticket)
+	{
+		RecycleCompletedSubmissions();
+		return Ticket.Value <= CompletedTicketValue;
+	}
+
+	void VLUploadEngine::Wait(VLUploadTicket Ticket)
+	{
+		if (bRecording && Ticket.Value >= PendingSubmission.TicketValue)
+		{
+			Submit();
+		}
+
+		// Note:	Batches complete in order, waiting on the fence of the ticket's batch covers all earlier ones
+		for (const Submission& submission : InFlightSubmissions)
+		{
+			if (submission.TicketValue == Ticket.Value)
+			{
+				vkWaitForFences(Device.GetDevice(), 1, &submission.Fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+				break;
+			}
+		}
+		RecycleCompletedSubmissions();
+	}
+
+	void VLUploadEngine::WaitIdle()
+	{
+		for (const Submission& submission : InFlightSubmissions)
+		{
+			vkWaitForFences(Device.GetDevice(), 1, &submission.Fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		RecycleCompletedSubmissions();
+	}
+
+	VLUploadEngine::Submission& VLUploadEngine::GetPendingSubmission()
+	{
+		if (bRecording)
+		{
+			return PendingSubmission;
+		}
+
+		RecycleCompletedSubmissions();
+		if (FreeSubmissions.empty())
+		{
+			FreeSubmissions.push_back(CreateSubmission());
+		}
+		PendingSubmission = std::move(FreeSubmissions.back());
+		FreeSubmissions.pop_back();
+		PendingSubmission.TicketValue = NextTicketValue++;
+
+		vkResetFences(Device.GetDevice(), 1, &PendingSubmission.Fence);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(PendingSubmission.TransferCommandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording transfer command buffer!");
+		}
+
+		bRecording = true;
+		return PendingSubmission;
+	}
+
+	void VLUploadEngine::RecycleCompletedSubmissions()
+	{
+		// Note:	Stop at the first batch still running, so the completed ticket value only ever moves forward
+		size_t completedCount = 0;
+		for (Submission& submission : InFlightSubmissions)
+		{
+			if (vkGetFenceStatus(Device.GetDevice(), submission.Fence) != VK_SUCCESS)
+			{
+				break;
+			}
+
+			vkResetCommandBuffer(submission.TransferCommandBuffer, 0);
+			if (submission.AcquireCommandBuffer != VK_NULL_HANDLE)
+			{
+				vkResetCommandBuffer(submission.AcquireCommandBuffer, 0);
+			}
+
+			// Keep regular staging chunks around for the next batches, oversized ones are released
+			for (StagingChunk& chunk : submission.StagingChunks)
+			{
+				if (chunk.Size > StagingChunkSize)
+				{
+					DestroyStagingChunk(chunk);
+				}
+				else
+				{
+					chunk.Head = 0;
+					FreeStagingChunks.push_back(chunk);
+				}
+			}
+			submission.StagingChunks.clear();
+
+			CompletedTicketValue = submission.TicketValue;
+			FreeSubmissions.push_back(std::move(submission));
+			completedCount++;
+		}
+		InFlightSubmissions.erase(InFlightSubmissions.begin(), InFlightSubmissions.begin() + completedCount);
+	}
+
+	VLUploadEngine::Submission VLUploadEngine::CreateSubmission()
+	{
+		Submission submission{};
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = TransferCommandPool;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &submission.TransferCommandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate transfer command buffer!");
+		}
+
+		if (bDedicatedQueue)
+		{
+			allocInfo.commandPool = AcquireCommandPool;
+			if (vkAllocateCommandBuffers(Device.GetDevice(), &allocInfo, &submission.AcquireCommandBuffer) !=
+				VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to allocate ownership acquire command buffer!");
+			}
+		}
+
+		const VkAllocationCallbacks* pAllocator = Device.GetAllocationCallbacks(VLHostAllocationCategory::Device);
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		if (vkCreateSemaphore(Device.GetDevice(), &semaphoreInfo, pAllocator, &submission.TransferFinishedSemaphore) !=
+			VK_SUCCESS ||
+			vkCreateFence(Device.GetDevice(), &fenceInfo, pAllocator, &submission.Fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create synchronization objects for an upload!");
+		}
+		return submission;
+	}
+
+	VkDeviceSize VLUploadEngine::AllocateStaging(VkDeviceSize Size, VkBuffer& OutBuffer, void*& OutData)
+	{
+		Submission& submission = GetPendingSubmission();
+
+		// Note:	16 bytes satisfies the offset alignment of buffer to image copies for every format
+		constexpr VkDeviceSize alignment = 16;
+		StagingChunk* pChunk = submission.StagingChunks.empty() ? nullptr : &submission.StagingChunks.back();
+		VkDeviceSize offset = pChunk ? (pChunk->Head + alignment - 1) / alignment * alignment : 0;
+		if (pChunk == nullptr || offset + Size > pChunk->Size)
+		{
+			if (Size <= StagingChunkSize && !FreeStagingChunks.empty())
+			{
+				submission.StagingChunks.push_back(FreeStagingChunks.back());
+				FreeStagingChunks.pop_back();
+			}
+			else
+			{
+				StagingChunk chunk{};
+				chunk.Size = std::max(Size, StagingChunkSize);
+				Device.CreateBuffer(
+					chunk.Size,
+					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					chunk.Buffer,
+					chunk.Allocation);
+				submission.StagingChunks.push_back(chunk);
+			}
+			pChunk = &submission.StagingChunks.back();
+			offset = 0;
+		}
+
+		pChunk->Head = offset + Size;
+		OutBuffer = pChunk->Buffer;
+		OutData = static_cast<char*>(pChunk->Allocation.pMapped) + offset;
+		return offset;
+	}
+
+	void VLUploadEngine::DestroyStagingChunk(StagingChunk& Chunk)
+	{
+		vkDestroyBuffer(Device.GetDevice(), Chunk.Buffer, Device.GetAllocationCallbacks(VLHostAllocationCategory::Device));
+		Device.FreeMemory(Chunk.Allocation);
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "VLDevice.h"
+
+#include <vector>
+
+namespace VulkanLearn
+{
+	// Identifies the batch an upload was recorded in. Batches complete in submission order, so a ticket is
+	// complete once the GPU has passed its value.
+	struct VLUploadTicket
+	{
+		uint64_t Value = 0;
+	};
+
+	// Collects buffer and image uploads into one command buffer per batch, recorded on the dedicated transfer queue
+	// (when the device has one) so asset streaming runs next to rendering instead of taking time on the graphics queue.
+	// Submitting never waits for the GPU, callers only block on a ticket when they really need the data on the host side.
+	// Note:	Resources are created with VK_SHARING_MODE_EXCLUSIVE, so every destination is released by the transfer
+	//			family and acquired by the graphics family. The acquire is submitted on the graphics queue and waits
+	//			on a semaphore the transfer submit signals, everything submitted to the graphics queue afterwards can
+	//			safely use the data.
+	//			Buffers that stay in use while more ranges are uploaded into them (sub-allocated pools) are created
+	//			with bConcurrentTransfer instead and passed with bConcurrentDst, they never change owner.
+	class VLUploadEngine
+	{
+	public:
+		VLUploadEngine(VLDevice& InDevice);
+		~VLUploadEngine();
+
+		VLUploadEngine(const VLUploadEngine&) = delete;
+		VLUploadEngine(VLUploadEngine&&) = delete;
+		VLUploadEngine& operator=(const VLUploadEngine&) = delete;
+		VLUploadEngine& operator=(VLUploadEngine&&) = delete;
+
+		// Records a copy into the pending batch, SrcBuffer must stay alive until the returned ticket has completed
+		VLUploadTicket CopyBuffer(VkBuffer SrcBuffer, VkBuffer DstBuffer, VkDeviceSize Size,
+			VkDeviceSize SrcOffset = 0, VkDeviceSize DstOffset = 0, bool bConcurrentDst = false);
+		// Records a copy into an image that is in VK_IMAGE_LAYOUT_UNDEFINED, the image ends up in FinalLayout
+		VLUploadTicket CopyBufferToImage(VkBuffer SrcBuffer, VkImage DstImage, uint32_t Width, uint32_t Height,
+			uint32_t LayerCount, VkImageLayout FinalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VkDeviceSize SrcOffset = 0);
+
+		// Same as above, but copies Data into staging memory owned by the batch first. The source can be freed
+		// right away, the staging memory is recycled once the batch has completed.
+		VLUploadTicket UploadToBuffer(const void* Data, VkDeviceSize Size, VkBuffer DstBuffer, VkDeviceSize DstOffset = 0,
+			bool bConcurrentDst = false);
+		VLUploadTicket UploadToImage(const void* Data, VkDeviceSize Size, VkImage DstImage, uint32_t Width,
+			uint32_t Height, uint32_t LayerCount, VkImageLayout FinalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		// Submits the pending batch without waiting for it
+		VLUploadTicket Submit();
+		bool IsComplete(VLUploadTicket Ticket);
+		// Blocks until the batch of the ticket has completed, submitting it first when still pending
+		void Wait(VLUploadTicket Ticket);
+		// Blocks until every submitted batch has completed on the GPU
+		void WaitIdle();
+
+		bool UsesDedicatedQueue() const { return bDedicatedQueue; }
+
+	private:
+		struct StagingChunk
+		{
+			VkBuffer Buffer = VK_NULL_HANDLE;
+			VLAllocation Allocation;
+			VkDeviceSize Size = 0;
+			VkDeviceSize Head = 0;
+		};
+
+		struct Submission
+		{
+			VkCommandBuffer TransferCommandBuffer = VK_NULL_HANDLE;
+			VkCommandBuffer AcquireCommandBuffer = VK_NULL_HANDLE;
+			VkSemaphore TransferFinishedSemaphore = VK_NULL_HANDLE;
+			VkFence Fence = VK_NULL_HANDLE;
+			uint64_t TicketValue = 0;
+			std::vector<StagingChunk> StagingChunks;
+		};
+
+		Submission& GetPendingSubmission();
+		// Returns the objects of completed submissions to the free lists
+		void RecycleCompletedSubmissions();
+		Submission CreateSubmission();
+		// Bump allocates staging memory for the pending batch
+		VkDeviceSize AllocateStaging(VkDeviceSize Size, VkBuffer& OutBuffer, void*& OutData);
+		void DestroyStagingChunk(StagingChunk& Chunk);
+
+		VLDevice& Device;
+		bool bDedicatedQueue;
+		uint32_t TransferFamily;
+		uint32_t GraphicsFamily;
+		VkQueue TransferQueue;
+
+		VkCommandPool TransferCommandPool;
+		// Only needed for the ownership acquire on the graphics family
+		VkCommandPool AcquireCommandPool = VK_NULL_HANDLE;
+
+		bool bRecording = false;
+		Submission PendingSubmission;
+		std::vector<VkBufferMemoryBarrier> PendingBufferTransfers;
+		std::vector<VkImageMemoryBarrier> PendingImageTransfers;
+		// In submission order, so they also complete in this order
+		std::vector<Submission> InFlightSubmissions;
+		std::vector<Submission> FreeSubmissions;
+		std::vector<StagingChunk> FreeStagingChunks;
+
+		uint64_t NextTicketValue = 1;
+		uint64_t CompletedTicketValue = 0;
+
+		static constexpr VkDeviceSize StagingChunkSize = 8ull * 1024 * 1024;
+	};
+}
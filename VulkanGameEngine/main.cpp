@@ -3,12 +3,32 @@
 
 #include "FirstApp.h"
 #include "SierpinskiTriangleApp.h"
+#include "VLStreamingCopy.h"
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <stdexcept>
 
-int main() 
+// Prints how fast memcpy and VLStreamingCopy write into every host visible memory type
+static void PrintStreamingCopyBenchmark(VulkanLearn::VLDevice& Device)
+{
+	static const char* pathNames[] = { "memcpy", "SSE2", "AVX" };
+	std::cout << "Streaming copy path: " << pathNames[static_cast<int>(VulkanLearn::VLGetStreamingCopyPath())]
+		<< std::endl;
+
+	for (const VulkanLearn::VLStreamingCopyBenchmarkResult& result : VulkanLearn::VLBenchmarkStreamingCopy(Device))
+	{
+		std::cout << "Memory type " << result.MemoryTypeIndex
+			<< ((result.PropertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) ? " DEVICE_LOCAL" : "")
+			<< ((result.PropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) ? " HOST_COHERENT" : "")
+			<< ((result.PropertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) ? " HOST_CACHED" : "")
+			<< ": memcpy " << result.MemcpyThroughput << " MB/s, streaming " << result.StreamingThroughput << " MB/s"
+			<< std::endl;
+	}
+}
+
+int main(int argc, char* argv[])
 {
 	// Uncomment the app you want to see
 	FirstApp app{};
@@ -16,6 +36,13 @@ int main()
 
 	try
 	{
+		// Note:	--benchmark-streaming-copy measures the upload copies instead of running the app
+		if (argc > 1 && std::strcmp(argv[1], "--benchmark-streaming-copy") == 0)
+		{
+			PrintStreamingCopyBenchmark(app.GetDevice());
+			return EXIT_SUCCESS;
+		}
+
 		app.run();
 	}
 	catch (const std::exception &e)